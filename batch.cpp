@@ -0,0 +1,256 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QSet>
+#include <QSettings>
+#include <QTextStream>
+
+#include "batch.h"
+#include "loader.h"
+#include "mesh.h"
+
+struct Batch::Job
+{
+    QString input;
+    QString output;
+
+    /*  Identifies the job to the scheduler, and owns its process and
+     *  loader */
+    QObject owner;
+    QProcess* process = nullptr;
+
+    QElapsedTimer timer;
+    qint64 queue_ms = 0;
+    qint64 render_ms = 0;
+    qint64 load_ms = 0;
+
+    QJsonObject mesh;
+};
+
+Batch::Batch(const QStringList& inputs, const QString& outdir,
+             float resolution, int max_jobs, QObject* parent)
+    : QObject(parent), resolution(resolution)
+{
+    if (max_jobs > 0)
+    {
+        scheduler.set_max_jobs(max_jobs);
+    }
+    // Scripts with the same name from different directories would write
+    // the same STL, so later ones get a numbered suffix (compared without
+    // case, for case-insensitive filesystems)
+    QSet<QString> names;
+    for (const auto& input : inputs)
+    {
+        std::unique_ptr<Job> job(new Job);
+        job->input = input;
+        const QString base = QFileInfo(input).completeBaseName();
+        QString name = base;
+        for (int i=2; names.contains(name.toLower()); ++i)
+        {
+            name = QString("%1-%2").arg(base).arg(i);
+        }
+        names.insert(name.toLower());
+        job->output = QDir(outdir).filePath(name + ".stl");
+        jobs.push_back(std::move(job));
+    }
+}
+
+Batch::~Batch()
+{
+    // Jobs' processes and loader threads must be stopped before the
+    // objects that own them go away
+    for (auto& job : jobs)
+    {
+        scheduler.release(&job->owner);
+        if (job->process)
+        {
+            job->process->kill();
+            job->process->waitForFinished();
+        }
+        for (auto loader : job->owner.findChildren<Loader*>())
+        {
+            loader->requestInterruption();
+            loader->wait();
+        }
+    }
+}
+
+void Batch::start()
+{
+    wall.start();
+    remaining = jobs.size();
+    if (!remaining)
+    {
+        emit finished(0);
+        return;
+    }
+
+    for (auto& j : jobs)
+    {
+        Job* job = j.get();
+        job->process = new QProcess(&job->owner);
+        job->process->setProgram("extopenscad");
+        job->process->setArguments(
+                extopenscad_args(job->input, job->output, resolution));
+
+        connect(job->process,
+                QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+                this, [=](int code, QProcess::ExitStatus status) {
+                    rendered(job, status == QProcess::NormalExit && !code);
+                });
+        connect(job->process, &QProcess::errorOccurred, this,
+                [=](QProcess::ProcessError error) {
+                    if (error == QProcess::FailedToStart)
+                    {
+                        scheduler.release(&job->owner);
+                        complete(job, "Could not start extopenscad");
+                    }
+                });
+
+        job->timer.start();
+        scheduler.request(&job->owner, [=](bool) {
+            job->queue_ms = job->timer.elapsed();
+            job->process->start();
+        });
+    }
+}
+
+void Batch::rendered(Job* job, bool ok)
+{
+    scheduler.release(&job->owner);
+    job->render_ms = job->timer.elapsed() - job->queue_ms;
+    if (!ok)
+    {
+        // complete() takes an empty error as success, so a render that
+        // failed silently still needs one
+        QString error = QString::fromLocal8Bit(
+                job->process->readAllStandardError()).trimmed();
+        if (error.isEmpty())
+        {
+            error = (job->process->exitStatus() == QProcess::CrashExit)
+                  ? QString("extopenscad crashed")
+                  : QString("extopenscad exited with code %1")
+                        .arg(job->process->exitCode());
+        }
+        complete(job, error);
+        return;
+    }
+
+    // Load the result back, both to check it and to measure it
+    Loader* loader = new Loader(&job->owner, job->output, true);
+    loader->set_lods(false);
+    loader->set_picking(false);
+    const auto fail = [=](const QString& error) {
+        return [=] { job->mesh["error"] = error; };
+    };
+    connect(loader, &Loader::error_bad_stl, this, fail("Bad STL"));
+    connect(loader, &Loader::error_bad_mesh_file, this, fail("Bad mesh file"));
+    connect(loader, &Loader::error_too_large, this, fail("Too many triangles"));
+    connect(loader, &Loader::error_empty_mesh, this, fail("Empty mesh"));
+    connect(loader, &Loader::error_missing_file, this, fail("Missing file"));
+    connect(loader, &Loader::got_mesh, this, [=](MeshPtr m, bool) {
+        loaded(job, m.get());
+    });
+    connect(loader, &Loader::finished, this, [=] {
+        job->load_ms = job->timer.elapsed() - job->queue_ms - job->render_ms;
+        complete(job, job->mesh.value("error").toString());
+    });
+    loader->start();
+}
+
+void Batch::loaded(Job* job, const Mesh* mesh)
+{
+    const auto triple = [](float x, float y, float z) {
+        return QJsonArray{x, y, z};
+    };
+    job->mesh["triangles"] = qint64(mesh->triangle_count());
+    job->mesh["vertices"] = qint64(mesh->vertex_count());
+    job->mesh["min"] = triple(mesh->xmin(), mesh->ymin(), mesh->zmin());
+    job->mesh["max"] = triple(mesh->xmax(), mesh->ymax(), mesh->zmax());
+}
+
+void Batch::complete(Job* job, const QString& error)
+{
+    QJsonObject entry = job->mesh;
+    entry["input"] = job->input;
+    entry["output"] = job->output;
+    entry["ok"] = error.isEmpty();
+    if (!error.isEmpty())
+    {
+        entry["error"] = error;
+        failures++;
+    }
+    entry["queue_ms"] = job->queue_ms;
+    entry["render_ms"] = job->render_ms;
+    entry["load_ms"] = job->load_ms;
+    entry["total_ms"] = job->timer.elapsed();
+    report.append(entry);
+
+    QTextStream(stderr) << (error.isEmpty() ? "done   " : "FAILED ")
+                        << job->input << "\n";
+
+    if (--remaining == 0)
+    {
+        QJsonObject result;
+        result["jobs"] = report;
+        result["max_jobs"] = scheduler.max_jobs();
+        result["wall_ms"] = wall.elapsed();
+        result["failures"] = failures;
+        QTextStream(stdout) << QJsonDocument(result).toJson();
+        emit finished(failures);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int run_batch(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+            "Renders scripts to STL without opening any windows, and prints "
+            "a JSON report of timings and mesh statistics.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("scripts", "Scripts to render", "[scripts...]");
+
+    QSettings settings("ImplicitCAD", "ExplicitCAD");
+    const QCommandLineOption batch("batch", "Run in batch mode.");
+    const QCommandLineOption res(
+            {"r", "resolution"}, "Render resolution (0 for the default).",
+            "resolution",
+            settings.value("render/export_resolution", 0.5).toString());
+    const QCommandLineOption out(
+            {"o", "output"}, "Directory to write STLs into.", "dir", ".");
+    const QCommandLineOption jobs(
+            {"j", "jobs"}, "Number of renders to run at once.", "jobs", "0");
+    const QCommandLineOption trace(
+            "trace", "Write a Chrome trace of the run to a file.", "file");
+    parser.addOptions({batch, res, out, jobs, trace});
+    parser.process(app);
+
+    bool ok = true;
+    const float resolution = parser.value(res).toFloat(&ok);
+    if (!ok || parser.positionalArguments().isEmpty())
+    {
+        parser.showHelp(1);
+    }
+    const QString outdir = parser.value(out);
+    if (!QDir().mkpath(outdir))
+    {
+        QTextStream(stderr) << "Could not create " << outdir << "\n";
+        return 1;
+    }
+
+    Batch runner(parser.positionalArguments(), outdir, resolution,
+                 parser.value(jobs).toInt());
+    QObject::connect(&runner, &Batch::finished, &app, [&](int failures) {
+        app.exit(failures ? 1 : 0);
+    });
+    runner.start();
+    return app.exec();
+}
@@ -0,0 +1,55 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QObject>
+#include <QStringList>
+
+#include <memory>
+#include <vector>
+
+#include "renderscheduler.h"
+
+class Mesh;
+
+/*
+ *  Headless batch mode: renders each input script to an STL in the output
+ *  directory, loads the result back through Loader to validate it, and
+ *  prints a JSON report with per-job timings and mesh statistics.  Jobs
+ *  run in parallel, up to the scheduler's limit.
+ */
+class Batch : public QObject
+{
+    Q_OBJECT
+public:
+    Batch(const QStringList& inputs, const QString& outdir, float resolution,
+          int max_jobs, QObject* parent=nullptr);
+    ~Batch();
+
+    /*  Starts every job; finished is emitted once they're all done */
+    void start();
+
+signals:
+    void finished(int failures);
+
+private:
+    struct Job;
+    void rendered(Job* job, bool ok);
+    void loaded(Job* job, const Mesh* mesh);
+    void complete(Job* job, const QString& error=QString());
+
+    RenderScheduler scheduler;
+    std::vector<std::unique_ptr<Job>> jobs;
+    const float resolution;
+
+    QElapsedTimer wall;
+    QJsonArray report;
+    int remaining = 0;
+    int failures = 0;
+};
+
+/*  Runs batch mode from the command line (see main.cpp) */
+int run_batch(int argc, char* argv[]);
+
+#endif // BATCH_H
@@ -0,0 +1,243 @@
+/*
+ *  Measures Canvas frame times without anyone at the mouse.  A hidden
+ *  Canvas (which renders into a framebuffer object on an offscreen
+ *  surface) is fed a scripted camera path of synthetic mouse drags and
+ *  wheel events, so the camera goes through the same transform_matrix
+ *  and view_matrix code as it does interactively.  Each frame is timed
+ *  from paintGL through glFinish.
+ *
+ *  Usage: bench_canvas [--max triangles] [--frames n]
+ *
+ *  UV spheres from 10K up to --max triangles (4M by default) are drawn
+ *  for --frames frames each (300 by default).  Unless set otherwise, the
+ *  offscreen Qt platform and Mesa's software renderer are selected; if
+ *  the offscreen platform has no OpenGL support on this system, run it
+ *  under xvfb-run with QT_QPA_PLATFORM=xcb instead.
+ *
+ *  Results are printed to stdout as JSON: frame time percentiles, draw
+ *  calls per frame and triangles drawn per second for each mesh.
+ */
+#include <QApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMouseEvent>
+#include <QStringList>
+#include <QWheelEvent>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+
+#include "canvas.h"
+#include "glmesh.h"
+#include "mesh.h"
+
+/*  Gives the benchmark access to paintGL and the GL context */
+class BenchCanvas : public Canvas
+{
+public:
+    using Canvas::Canvas;
+
+    /*  Renders one frame, returning how long it took in milliseconds */
+    double frame()
+    {
+        makeCurrent();
+        const auto start = std::chrono::steady_clock::now();
+        paintGL();
+        glFinish();
+        const auto end = std::chrono::steady_clock::now();
+        doneCurrent();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    QString renderer()
+    {
+        makeCurrent();
+        const QString r = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+        doneCurrent();
+        return r;
+    }
+};
+
+/*  Builds an indexed UV sphere with roughly tri_count triangles */
+static Mesh* sphere_mesh(uint32_t tri_count)
+{
+    const uint32_t rings = std::max<uint32_t>(2, std::sqrt(tri_count / 4.0));
+    const uint32_t segments = rings * 2;
+
+    std::vector<GLfloat> vertices;
+    vertices.reserve((rings + 1) * (segments + 1) * 3);
+    for (uint32_t r=0; r <= rings; ++r)
+    {
+        const double phi = M_PI * r / rings;
+        for (uint32_t s=0; s <= segments; ++s)
+        {
+            const double theta = 2 * M_PI * s / segments;
+            vertices.push_back(10 * sin(phi) * cos(theta));
+            vertices.push_back(10 * sin(phi) * sin(theta));
+            vertices.push_back(10 * cos(phi));
+        }
+    }
+
+    std::vector<GLuint> indices;
+    indices.reserve(rings * segments * 6);
+    for (uint32_t r=0; r < rings; ++r)
+    {
+        for (uint32_t s=0; s < segments; ++s)
+        {
+            const GLuint a = r * (segments + 1) + s;
+            const GLuint b = a + segments + 1;
+            indices.insert(indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+        }
+    }
+    return new Mesh(std::move(vertices), std::move(indices));
+}
+
+/*  Sends the input for one frame of the camera path: an orbit with the
+ *  left button, then a zoom in, a pan with the right button and a zoom
+ *  back out, each taking a quarter of the frames */
+static void camera_step(Canvas& canvas, int frame, int frames)
+{
+    const QPointF centre(canvas.width() / 2.0, canvas.height() / 2.0);
+    // Phases are split by the same expression throughout, so that every
+    // drag gets its press on the phase's first frame and its release on
+    // the last, whether or not frames is a multiple of four
+    const auto phase_of = [=](int f) { return f * 4 / frames; };
+    const int phase = phase_of(frame);
+    const int step = frame - (phase * frames + 3) / 4;
+    const bool last = phase_of(frame + 1) != phase;
+
+    if (phase == 0 || phase == 2)
+    {
+        const auto button = phase ? Qt::RightButton : Qt::LeftButton;
+        const QPointF from = centre + QPointF(step * 2, step);
+        const QPointF to = from + QPointF(2, 1);
+        if (step == 0)
+        {
+            QMouseEvent press(QEvent::MouseButtonPress, from, button, button,
+                              Qt::NoModifier);
+            QCoreApplication::sendEvent(&canvas, &press);
+        }
+        QMouseEvent move(QEvent::MouseMove, to, Qt::NoButton, button,
+                         Qt::NoModifier);
+        QCoreApplication::sendEvent(&canvas, &move);
+        if (last)
+        {
+            QMouseEvent release(QEvent::MouseButtonRelease, to, button,
+                                Qt::NoButton, Qt::NoModifier);
+            QCoreApplication::sendEvent(&canvas, &release);
+        }
+    }
+    else
+    {
+        const int delta = (phase == 1) ? 15 : -15;
+        QWheelEvent wheel(centre, canvas.mapToGlobal(centre.toPoint()),
+                          QPoint(), QPoint(0, delta), Qt::NoButton,
+                          Qt::NoModifier, Qt::NoScrollPhase, false);
+        QCoreApplication::sendEvent(&canvas, &wheel);
+    }
+}
+
+static double percentile(std::vector<double> v, double p)
+{
+    std::sort(v.begin(), v.end());
+    return v[std::min<size_t>(v.size() - 1, p * v.size())];
+}
+
+int main(int argc, char** argv)
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    if (qEnvironmentVariableIsEmpty("LIBGL_ALWAYS_SOFTWARE"))
+    {
+        qputenv("LIBGL_ALWAYS_SOFTWARE", "1");
+    }
+    QApplication app(argc, argv);
+
+    uint32_t max_tris = 4000000;
+    int frames = 300;
+    const QStringList args = app.arguments().mid(1);
+    for (int i=0; i + 1 < args.size(); ++i)
+    {
+        if (args[i] == "--max")
+        {
+            max_tris = args[++i].toUInt();
+        }
+        else if (args[i] == "--frames")
+        {
+            frames = std::max(4, args[++i].toInt());
+        }
+    }
+
+    // Same surface format as the tabs use
+    QSurfaceFormat format;
+    format.setDepthBufferSize(24);
+    format.setStencilBufferSize(8);
+    format.setVersion(2, 1);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    QSurfaceFormat::setDefaultFormat(format);
+
+    BenchCanvas canvas(format);
+    canvas.resize(1280, 720);
+
+    // Grabbing the framebuffer initializes GL for the hidden widget
+    canvas.grabFramebuffer();
+
+    // Sizes go up tenfold, finishing with max_tris itself
+    std::vector<uint32_t> sizes;
+    for (uint32_t n=10000; n < max_tris; n *= 10)
+    {
+        sizes.push_back(n);
+    }
+    sizes.push_back(max_tris);
+
+    QJsonArray results;
+    for (const uint32_t n : sizes)
+    {
+        const MeshPtr mesh(sphere_mesh(n));
+        const qint64 tris = mesh->triangle_count();
+        canvas.load_mesh(mesh, false);
+
+        // Warm up, so that uploads and shader compilation aren't counted
+        for (int i=0; i < 10; ++i)
+        {
+            canvas.frame();
+        }
+
+        std::vector<double> times;
+        const quint64 draws = GLMesh::draw_calls();
+        for (int i=0; i < frames; ++i)
+        {
+            camera_step(canvas, i, frames);
+            times.push_back(canvas.frame());
+        }
+        const double total_ms = std::accumulate(times.begin(), times.end(), 0.0);
+
+        QJsonObject result;
+        result["triangles"] = tris;
+        result["frames"] = frames;
+        result["mean_ms"] = total_ms / frames;
+        result["p50_ms"] = percentile(times, 0.50);
+        result["p95_ms"] = percentile(times, 0.95);
+        result["p99_ms"] = percentile(times, 0.99);
+        result["draw_calls_per_frame"] =
+            double(GLMesh::draw_calls() - draws) / frames;
+        result["tris_per_s"] = tris * frames / (total_ms / 1000);
+        results.append(result);
+        fprintf(stderr, "%lld triangles done\n", static_cast<long long>(tris));
+    }
+
+    QJsonObject report;
+    report["renderer"] = canvas.renderer();
+    report["width"] = canvas.width();
+    report["height"] = canvas.height();
+    report["results"] = results;
+    printf("%s", QJsonDocument(report).toJson().constData());
+
+    return 0;
+}
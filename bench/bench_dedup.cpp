@@ -0,0 +1,86 @@
+/*
+ *  Compares the merge sort, radix sort and hash table vertex deduplication
+ *  engines.
+ *
+ *  Usage: bench_dedup [file.stl ...] [-n triangles]
+ *
+ *  With no files, gl/testfile.stl is used.  A synthetic grid mesh with the
+ *  given number of triangles (10M by default) is always benchmarked too.
+ */
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+
+#include <chrono>
+#include <cstdio>
+
+#include "fixtures.h"
+#include "loader.h"
+
+static double time_dedup(const std::vector<Vertex>& input, DedupMethod method,
+                         size_t* unique)
+{
+    // mesh_from_verts uses its input as scratch space, so work on a copy
+    std::vector<Vertex> verts = input;
+
+    const auto start = std::chrono::steady_clock::now();
+    Mesh* mesh = mesh_from_verts(verts.size() / 3, verts, method);
+    const auto end = std::chrono::steady_clock::now();
+
+    *unique = mesh->vertex_count();
+    delete mesh;
+    return std::chrono::duration<double>(end - start).count();
+}
+
+static void bench(const QString& name, const std::vector<Vertex>& verts)
+{
+    const auto tris = verts.size() / 3;
+    for (auto method : {DedupMethod::Sort, DedupMethod::Radix,
+                        DedupMethod::Hash})
+    {
+        size_t unique = 0;
+        const double t = time_dedup(verts, method, &unique);
+        printf("%-24s %-6s %10zu tris %10zu verts %9.3f s %12.0f tris/s\n",
+               qPrintable(name), qPrintable(dedup_method_name(method)),
+               tris, unique, t, tris / t);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList files;
+    uint32_t synthetic = 10000000;
+    const QStringList args = app.arguments().mid(1);
+    for (int i=0; i < args.size(); ++i)
+    {
+        if (args[i] == "-n" && i + 1 < args.size())
+        {
+            synthetic = args[++i].toUInt();
+        }
+        else
+        {
+            files << args[i];
+        }
+    }
+    if (files.isEmpty())
+    {
+        files << BENCH_SOURCE_DIR "/gl/testfile.stl";
+    }
+
+    for (const auto& f : files)
+    {
+        const auto verts = read_binary_stl(f);
+        if (verts.empty())
+        {
+            fprintf(stderr, "Could not read binary STL %s\n", qPrintable(f));
+            return 1;
+        }
+        bench(QFileInfo(f).fileName(), verts);
+    }
+    bench(QString("grid-%1").arg(synthetic), grid_mesh(synthetic));
+
+    return 0;
+}
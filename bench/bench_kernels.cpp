@@ -0,0 +1,109 @@
+/*
+ *  Times each of the per-vertex kernels with every instruction set this
+ *  CPU supports, and reports the speedup over the scalar versions.
+ *
+ *  Usage: bench_kernels [-n vertices]
+ */
+#include <QCoreApplication>
+#include <QStringList>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+
+#include "kernels.h"
+
+/*  Returns the best of a few runs, in seconds */
+static double best_time(const std::function<void()>& f)
+{
+    double best = 1e30;
+    for (int i=0; i < 5; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    size_t n = 10000000;
+    const QStringList args = app.arguments();
+    const int i = args.indexOf("-n");
+    if (i != -1 && i + 1 < args.size())
+    {
+        n = args[i + 1].toULongLong();
+    }
+    n -= n % 3;
+
+    // Random input data, shared by every kernel
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-100, 100);
+    std::vector<GLfloat> xyz(n * 3);
+    for (auto& f : xyz)
+    {
+        f = dist(rng);
+    }
+    std::vector<uint8_t> records(n / 3 * 50);
+    for (size_t t=0; t < n / 3; ++t)
+    {
+        memcpy(&records[t * 50 + 12], &xyz[t * 9], 9 * sizeof(float));
+    }
+    std::vector<Vertex> verts(n);
+    for (size_t v=0; v < n; ++v)
+    {
+        memcpy(&verts[v], &xyz[v * 3], 3 * sizeof(float));
+    }
+
+    std::vector<Vertex> out_verts(n);
+    std::vector<GLfloat> out_xyz(n * 3);
+    std::vector<uint16_t> out_q(n * 4);
+    const float offset[3] = {-100, -100, -100};
+    const float scale[3] = {65535 / 200.0f, 65535 / 200.0f, 65535 / 200.0f};
+
+    const std::vector<std::pair<const char*, std::function<void()>>> kernels = {
+        {"bounds", [&] {
+            Bounds b;
+            Kernels::bounds(xyz.data(), n, b);
+        }},
+        {"deinterleave_stl", [&] {
+            Kernels::deinterleave_stl(records.data(), n / 3, out_verts.data());
+        }},
+        {"flatten", [&] {
+            Bounds b;
+            Kernels::flatten(verts.data(), n, out_xyz.data(), b);
+        }},
+        {"quantize", [&] {
+            Kernels::quantize(xyz.data(), n, offset, scale, out_q.data());
+        }},
+    };
+
+    printf("%-18s %-7s %10s %10s\n", "kernel", "isa", "ns/vertex", "speedup");
+    for (const auto& k : kernels)
+    {
+        double scalar = 0;
+        for (auto isa : {Kernels::Isa::Scalar, Kernels::Isa::SSE2,
+                         Kernels::Isa::AVX2})
+        {
+            if (!Kernels::set_isa(isa))
+            {
+                continue;
+            }
+            const double t = best_time(k.second);
+            if (isa == Kernels::Isa::Scalar)
+            {
+                scalar = t;
+            }
+            printf("%-18s %-7s %10.3f %9.2fx\n", k.first,
+                   Kernels::isa_name(isa), t * 1e9 / n, scalar / t);
+        }
+    }
+
+    return 0;
+}
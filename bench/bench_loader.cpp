@@ -0,0 +1,239 @@
+/*
+ *  Benchmarks the loader's stages: the binary and ASCII STL readers,
+ *  followed by sorting and deduplication in mesh_from_verts (with the
+ *  dedup method from the loader/dedup setting, as the loader uses).
+ *
+ *  Usage: bench_loader [file.stl ...] [--max triangles] [--ascii-max triangles]
+ *
+ *  gl/testfile.stl and gl/sphere.stl are always included, along with
+ *  synthetic grid meshes from 10K up to --max triangles (50M by default,
+ *  and never more than the loader accepts).
+ *  ASCII copies of the synthetic meshes are only written and read up to
+ *  --ascii-max triangles (1M by default), since they get very large.
+ *
+ *  Results are printed to stdout as JSON, one entry per input, with the
+ *  time for each stage (as recorded in the loader's LoadStats), throughput
+ *  in triangles/s, and the process's peak resident set size so far.  A
+ *  reader that fails is reported as <reader>_error and its times left out.
+ */
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSettings>
+#include <QStringList>
+#include <QTemporaryDir>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+#include <sys/resource.h>
+
+#include "fixtures.h"
+#include "loader.h"
+
+/*  Exposes the loader's readers, which are normally only called from its
+ *  own thread */
+class BenchLoader : public Loader
+{
+public:
+    BenchLoader() : Loader(nullptr, QString(), true) {}
+    using Loader::read_stl_ascii;
+    using Loader::read_stl_binary;
+    const LoadStats& load_stats() const { return stats; }
+};
+
+static double seconds(const std::function<void()>& f)
+{
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/*  Returns the peak resident set size of this process, in kilobytes */
+static qint64 peak_rss_kb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef Q_OS_MAC
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+/*  Times one reader on a file, returning the mesh it built (or NULL if
+ *  the reader failed) and filling in the time for each of its stages */
+static Mesh* time_reader(const QString& filename, bool ascii, LoadStats* stats)
+{
+    BenchLoader loader;
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return NULL;
+    }
+    Mesh* mesh = NULL;
+    const double t = seconds([&] {
+        mesh = ascii ? loader.read_stl_ascii(file)
+                     : loader.read_stl_binary(file);
+    });
+
+    // Split up the same way as in Loader::run
+    *stats = loader.load_stats();
+    stats->parse_ms = t * 1000 - stats->sort_ms - stats->dedup_ms
+                    - stats->wait_ms;
+    return mesh;
+}
+
+/*  Adds a reader's total time and throughput, and the time spent in each
+ *  stage, to the result */
+static void add_reader(const QString& key, const LoadStats& stats,
+                       QJsonObject& result)
+{
+    const double t = (stats.parse_ms + stats.sort_ms + stats.dedup_ms) / 1000;
+    result[key + "_s"] = t;
+    result[key + "_tris_per_s"] = stats.triangles / t;
+    result[key + "_parse_s"] = stats.parse_ms / 1000;
+    result[key + "_sort_s"] = stats.sort_ms / 1000;
+    result[key + "_dedup_s"] = stats.dedup_ms / 1000;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList files = {BENCH_SOURCE_DIR "/gl/testfile.stl",
+                         BENCH_SOURCE_DIR "/gl/sphere.stl"};
+    uint32_t max_tris = 50000000;
+    uint32_t ascii_max = 1000000;
+    const QStringList args = app.arguments().mid(1);
+    for (int i=0; i < args.size(); ++i)
+    {
+        if (args[i] == "--max" && i + 1 < args.size())
+        {
+            max_tris = args[++i].toUInt();
+        }
+        else if (args[i] == "--ascii-max" && i + 1 < args.size())
+        {
+            ascii_max = args[++i].toUInt();
+        }
+        else
+        {
+            files << args[i];
+        }
+    }
+
+    // Larger meshes would only be turned away with error_too_large
+    const uint32_t limit = Loader::max_vertices / 3;
+    if (max_tris > limit)
+    {
+        fprintf(stderr, "Limiting --max to the loader's %u triangles\n", limit);
+        max_tris = limit;
+    }
+
+    // The loaders pick the same dedup method up from the settings
+    QSettings settings("ImplicitCAD", "ExplicitCAD");
+    const QString dedup_name = dedup_method_name(dedup_method_from_name(
+            settings.value("loader/dedup", "radix").toString()));
+
+    QJsonArray results;
+
+    // Existing files are read with whichever reader suits them
+    for (const auto& f : files)
+    {
+        QFile file(f);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            fprintf(stderr, "Could not open %s\n", qPrintable(f));
+            return 1;
+        }
+        const bool ascii = Loader::is_ascii_stl(file);
+        file.close();
+
+        LoadStats stats;
+        Mesh* mesh = time_reader(f, ascii, &stats);
+        if (!mesh)
+        {
+            fprintf(stderr, "Could not load %s\n", qPrintable(f));
+            return 1;
+        }
+
+        QJsonObject result;
+        result["name"] = QFileInfo(f).fileName();
+        result["triangles"] = qint64(stats.triangles);
+        result["unique_vertices"] = qint64(mesh->vertex_count());
+        add_reader(ascii ? "ascii" : "binary", stats, result);
+        result["peak_rss_kb"] = peak_rss_kb();
+        results.append(result);
+        delete mesh;
+        fprintf(stderr, "%s done\n", qPrintable(f));
+    }
+
+    // Synthetic meshes go through temporary files, so that the readers
+    // see real I/O
+    QTemporaryDir dir;
+    const QString binary = dir.filePath("grid.stl");
+    const QString ascii = dir.filePath("grid-ascii.stl");
+    for (qint64 n=10000; n <= max_tris; n = (n < max_tris)
+                                            ? std::min<qint64>(n * 10, max_tris)
+                                            : n + 1)
+    {
+        const QString name = QString("grid-%1").arg(n);
+        QJsonObject result;
+        result["name"] = name;
+
+        // The fixture is dropped before reading, so that it doesn't count
+        // towards the readers' peak RSS
+        const bool with_ascii = n <= ascii_max;
+        {
+            const std::vector<Vertex> verts = grid_mesh(n);
+            result["triangles"] = qint64(verts.size() / 3);
+            if (!write_binary_stl(binary, verts) ||
+                (with_ascii && !write_ascii_stl(ascii, verts)))
+            {
+                fprintf(stderr, "Could not write %s\n", qPrintable(name));
+                return 1;
+            }
+        }
+
+        for (const bool a : {false, true})
+        {
+            if (a && !with_ascii)
+            {
+                continue;
+            }
+            const QString reader = a ? "ascii" : "binary";
+            LoadStats stats;
+            Mesh* mesh = time_reader(a ? ascii : binary, a, &stats);
+            QFile::remove(a ? ascii : binary);
+            if (!mesh)
+            {
+                fprintf(stderr, "%s: %s reader failed, skipping\n",
+                        qPrintable(name), qPrintable(reader));
+                result[reader + "_error"] = "reader failed";
+                continue;
+            }
+            result["unique_vertices"] = qint64(mesh->vertex_count());
+            add_reader(reader, stats, result);
+            delete mesh;
+        }
+
+        result["peak_rss_kb"] = peak_rss_kb();
+        results.append(result);
+        fprintf(stderr, "%s done\n", qPrintable(name));
+    }
+
+    QJsonObject report;
+    report["dedup"] = dedup_name;
+    report["threads"] = int(std::thread::hardware_concurrency());
+    report["results"] = results;
+    printf("%s", QJsonDocument(report).toJson().constData());
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ *  Synthetic meshes and STL readers and writers shared by the benchmarks
+ */
+#ifndef BENCH_FIXTURES_H
+#define BENCH_FIXTURES_H
+
+#include <QFile>
+#include <QtEndian>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "vertex.h"
+
+/*  Builds a square grid of 2 * n * n triangles with shared corners */
+static inline std::vector<Vertex> grid_mesh(uint32_t tri_count)
+{
+    uint32_t n = 1;
+    while (2 * (n + 1) * (n + 1) <= tri_count)
+    {
+        n++;
+    }
+
+    std::vector<Vertex> verts;
+    verts.reserve(size_t(n) * n * 6);
+    for (uint32_t i=0; i < n; ++i)
+    {
+        for (uint32_t j=0; j < n; ++j)
+        {
+            const Vertex a(i, j, 0), b(i + 1, j, 0),
+                         c(i, j + 1, 0), d(i + 1, j + 1, 0);
+            verts.insert(verts.end(), {a, b, d, a, d, c});
+        }
+    }
+    return verts;
+}
+
+/*  Reads the raw vertices of a binary STL file */
+static inline std::vector<Vertex> read_binary_stl(const QString& filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return {};
+    }
+    const QByteArray data = file.readAll();
+    if (data.size() < 84)
+    {
+        return {};
+    }
+    const uint32_t tri_count = qFromLittleEndian<quint32>(
+            reinterpret_cast<const uchar*>(data.constData() + 80));
+    if (data.size() != 84 + qint64(tri_count) * 50)
+    {
+        return {};
+    }
+
+    std::vector<Vertex> verts(size_t(tri_count) * 3);
+    const char* b = data.constData() + 84;
+    for (uint32_t t=0; t < tri_count; ++t)
+    {
+        b += 3 * sizeof(float);
+        for (unsigned i=0; i < 3; ++i)
+        {
+            memcpy(&verts[size_t(t)*3 + i], b, 3 * sizeof(float));
+            b += 3 * sizeof(float);
+        }
+        b += sizeof(uint16_t);
+    }
+    return verts;
+}
+
+static inline bool write_binary_stl(const QString& filename,
+                                    const std::vector<Vertex>& verts)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    QByteArray header(84, 0);
+    qToLittleEndian<quint32>(verts.size() / 3,
+                             reinterpret_cast<uchar*>(header.data() + 80));
+    file.write(header);
+
+    QByteArray record(50, 0);
+    for (size_t t=0; t < verts.size(); t += 3)
+    {
+        for (size_t i=0; i < 3; ++i)
+        {
+            const float xyz[3] = {verts[t + i].x, verts[t + i].y,
+                                  verts[t + i].z};
+            memcpy(record.data() + 12 * (i + 1), xyz, sizeof(xyz));
+        }
+        file.write(record);
+    }
+    return true;
+}
+
+static inline bool write_ascii_stl(const QString& filename,
+                                   const std::vector<Vertex>& verts)
+{
+    FILE* f = fopen(QFile::encodeName(filename).constData(), "w");
+    if (!f)
+    {
+        return false;
+    }
+    fprintf(f, "solid bench\n");
+    for (size_t t=0; t < verts.size(); t += 3)
+    {
+        fprintf(f, "  facet normal 0 0 0\n    outer loop\n");
+        for (size_t i=0; i < 3; ++i)
+        {
+            fprintf(f, "      vertex %g %g %g\n", verts[t + i].x,
+                    verts[t + i].y, verts[t + i].z);
+        }
+        fprintf(f, "    endloop\n  endfacet\n");
+    }
+    fprintf(f, "endsolid bench\n");
+    fclose(f);
+    return true;
+}
+
+#endif // BENCH_FIXTURES_H
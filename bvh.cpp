@@ -0,0 +1,519 @@
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <thread>
+
+#include "bvh.h"
+#include "trace.h"
+
+static const int bin_count = 16;
+static const uint32_t max_leaf = 4;
+
+/*  Subtrees smaller than this aren't worth handing to another thread */
+static const uint32_t parallel_min = 1 << 16;
+
+static const float inf = std::numeric_limits<float>::infinity();
+
+/*  Like Bounds::add, but without fmin's NaN handling, which is measurably
+ *  slower in the build's inner loops */
+static void grow(Bounds& b, const Bounds& other)
+{
+    for (int i=0; i < 3; ++i)
+    {
+        b.lower[i] = std::min(b.lower[i], other.lower[i]);
+        b.upper[i] = std::max(b.upper[i], other.upper[i]);
+    }
+}
+
+static float area(const Bounds& b)
+{
+    const float dx = b.upper[0] - b.lower[0];
+    const float dy = b.upper[1] - b.lower[1];
+    const float dz = b.upper[2] - b.lower[2];
+    return (dx < 0) ? 0 : 2 * (dx*dy + dy*dz + dz*dx);
+}
+
+Bvh::Bvh(MeshPtr m)
+    : mesh(m), vertices(mesh->vertex_data()), indices(mesh->index_data())
+{
+    const uint32_t tri_count = mesh->triangle_count();
+    if (!tri_count)
+    {
+        return;
+    }
+    Trace::Span span("Bvh::Bvh");
+
+    auto threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+    {
+        threads = 8;
+    }
+
+    // Centroids are only needed while building, and are computed up
+    // front in parallel since every level of the build reads them
+    std::vector<float> centroids(size_t(tri_count) * 3);
+    tris.resize(tri_count);
+    {
+        std::vector<std::future<void>> futures;
+        const uint32_t chunk = (tri_count + threads - 1) / threads;
+        for (uint32_t begin=0; begin < tri_count; begin += chunk)
+        {
+            const uint32_t end = std::min(tri_count, begin + chunk);
+            futures.push_back(std::async(std::launch::async, [&, begin, end] {
+                for (uint32_t t=begin; t < end; ++t)
+                {
+                    tris[t] = t;
+                    for (int i=0; i < 3; ++i)
+                    {
+                        centroids[t*3 + i] = (vertices[indices[t*3]*3 + i] +
+                                              vertices[indices[t*3 + 1]*3 + i] +
+                                              vertices[indices[t*3 + 2]*3 + i]) / 3;
+                    }
+                }
+            }));
+        }
+        for (auto& f : futures)
+        {
+            f.get();
+        }
+    }
+
+    nodes.reserve(2 * tri_count / max_leaf);
+    build(nodes, 0, tri_count, threads, centroids);
+    nodes.shrink_to_fit();
+}
+
+Bounds Bvh::triangle_bounds(uint32_t t) const
+{
+    const GLfloat* a = &vertices[indices[t*3]*3];
+    const GLfloat* b = &vertices[indices[t*3 + 1]*3];
+    const GLfloat* c = &vertices[indices[t*3 + 2]*3];
+    Bounds out;
+    for (int i=0; i < 3; ++i)
+    {
+        out.lower[i] = std::min(std::min(a[i], b[i]), c[i]);
+        out.upper[i] = std::max(std::max(a[i], b[i]), c[i]);
+    }
+    return out;
+}
+
+QVector3D Bvh::corner(uint32_t t, int i) const
+{
+    const GLfloat* v = &vertices[indices[t*3 + i]*3];
+    return QVector3D(v[0], v[1], v[2]);
+}
+
+void Bvh::build(std::vector<Node>& out, uint32_t begin, uint32_t end,
+                unsigned threads, const std::vector<float>& centroids)
+{
+    const uint32_t index = out.size();
+    out.push_back(Node());
+
+    const uint32_t count = end - begin;
+    Bounds box;
+    const auto set_box = [&] {
+        std::copy(box.lower, box.lower + 3, out[index].lower);
+        std::copy(box.upper, box.upper + 3, out[index].upper);
+    };
+    const auto make_leaf = [&] {
+        out[index].start = begin;
+        out[index].count = count;
+    };
+    if (count <= max_leaf)
+    {
+        for (uint32_t i=begin; i < end; ++i)
+        {
+            grow(box, triangle_bounds(tris[i]));
+        }
+        set_box();
+        make_leaf();
+        return;
+    }
+
+    Bounds cbox;
+    for (uint32_t i=begin; i < end; ++i)
+    {
+        const float* c = &centroids[tris[i]*3];
+        for (int a=0; a < 3; ++a)
+        {
+            cbox.lower[a] = std::min(cbox.lower[a], c[a]);
+            cbox.upper[a] = std::max(cbox.upper[a], c[a]);
+        }
+    }
+
+    // Bin triangles by centroid along every axis at once, so that each
+    // triangle's bounds are only computed once per level (the node's own
+    // box then comes from merging the bins)
+    float scale[3];
+    for (int a=0; a < 3; ++a)
+    {
+        const float extent = cbox.upper[a] - cbox.lower[a];
+        scale[a] = (extent > 0) ? bin_count / extent : 0;
+    }
+    const auto bin = [&](uint32_t t, int a) {
+        return std::min(bin_count - 1,
+                        int((centroids[t*3 + a] - cbox.lower[a]) * scale[a]));
+    };
+
+    Bounds bins[3][bin_count];
+    uint32_t counts[3][bin_count] = {};
+    for (uint32_t i=begin; i < end; ++i)
+    {
+        const Bounds b = triangle_bounds(tris[i]);
+        for (int a=0; a < 3; ++a)
+        {
+            const int k = bin(tris[i], a);
+            grow(bins[a][k], b);
+            counts[a][k]++;
+        }
+    }
+    for (int k=0; k < bin_count; ++k)
+    {
+        grow(box, bins[0][k]);
+    }
+    set_box();
+
+    // Sweep each axis from both ends to find the cheapest split, where a
+    // side costs its surface area times its number of triangles
+    int best_axis = -1;
+    int best_split = 0;
+    float best_cost = inf;
+    for (int a=0; a < 3; ++a)
+    {
+        if (scale[a] == 0)
+        {
+            continue;
+        }
+        float right_cost[bin_count];
+        Bounds acc;
+        uint32_t n = 0;
+        for (int k=bin_count - 1; k > 0; --k)
+        {
+            grow(acc, bins[a][k]);
+            n += counts[a][k];
+            right_cost[k] = n ? area(acc) * n : inf;
+        }
+        acc = Bounds();
+        n = 0;
+        for (int k=0; k < bin_count - 1; ++k)
+        {
+            grow(acc, bins[a][k]);
+            n += counts[a][k];
+            const float cost = n ? area(acc) * n + right_cost[k + 1] : inf;
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = a;
+                best_split = k + 1;
+            }
+        }
+    }
+
+    uint32_t mid;
+    if (best_axis == -1)
+    {
+        // Every centroid is in the same place, so split down the middle
+        // rather than leaving one huge leaf
+        mid = begin + count / 2;
+    }
+    else
+    {
+        // Small nodes stay leaves if splitting wouldn't pay for the extra
+        // traversal step
+        if (count <= max_leaf * 4 && best_cost >= area(box) * (count - 1))
+        {
+            make_leaf();
+            return;
+        }
+        mid = std::partition(tris.begin() + begin, tris.begin() + end,
+                             [&](uint32_t t) {
+                                 return bin(t, best_axis) < best_split;
+                             }) - tris.begin();
+    }
+
+    if (threads > 1 && count >= parallel_min)
+    {
+        // The right subtree is built into its own array, then appended
+        // with its child links shifted to their new position
+        std::vector<Node> right;
+        auto future = std::async(std::launch::async, [&] {
+            build(right, mid, end, threads / 2, centroids);
+        });
+        build(out, begin, mid, threads - threads / 2, centroids);
+        future.get();
+
+        const uint32_t base = out.size();
+        for (Node n : right)
+        {
+            if (!n.count)
+            {
+                n.start += base;
+            }
+            out.push_back(n);
+        }
+        out[index].start = base;
+    }
+    else
+    {
+        build(out, begin, mid, 1, centroids);
+        out[index].start = out.size();
+        build(out, mid, end, 1, centroids);
+    }
+    out[index].count = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*  Returns where a ray enters a box, or infinity if it misses */
+static float ray_box(const float* lower, const float* upper,
+                     const QVector3D& origin, const float* inv_dir)
+{
+    float tmin = 0;
+    float tmax = inf;
+    for (int i=0; i < 3; ++i)
+    {
+        // A ray parallel to this axis either stays within the slab or
+        // misses it entirely (and 0 * inf would give NaN below)
+        if (std::isinf(inv_dir[i]))
+        {
+            if (origin[i] < lower[i] || origin[i] > upper[i])
+            {
+                return inf;
+            }
+            continue;
+        }
+        const float t1 = (lower[i] - origin[i]) * inv_dir[i];
+        const float t2 = (upper[i] - origin[i]) * inv_dir[i];
+        tmin = fmax(tmin, fmin(t1, t2));
+        tmax = fmin(tmax, fmax(t1, t2));
+    }
+    return (tmin <= tmax) ? tmin : inf;
+}
+
+/*  Möller-Trumbore intersection, returning the distance along the ray or
+ *  infinity on a miss */
+static float ray_triangle(const QVector3D& origin, const QVector3D& dir,
+                          const QVector3D& a, const QVector3D& b,
+                          const QVector3D& c)
+{
+    const QVector3D e1 = b - a;
+    const QVector3D e2 = c - a;
+    const QVector3D p = QVector3D::crossProduct(dir, e2);
+    const float det = QVector3D::dotProduct(e1, p);
+    if (det == 0)
+    {
+        return inf;
+    }
+    const float inv_det = 1 / det;
+
+    const QVector3D s = origin - a;
+    const float u = QVector3D::dotProduct(s, p) * inv_det;
+    if (u < 0 || u > 1)
+    {
+        return inf;
+    }
+    const QVector3D q = QVector3D::crossProduct(s, e1);
+    const float v = QVector3D::dotProduct(dir, q) * inv_det;
+    if (v < 0 || u + v > 1)
+    {
+        return inf;
+    }
+    const float t = QVector3D::dotProduct(e2, q) * inv_det;
+    return (t >= 0) ? t : inf;
+}
+
+bool Bvh::raycast(const QVector3D& origin, const QVector3D& dir, Hit& hit) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+    const float inv_dir[3] = {1 / dir.x(), 1 / dir.y(), 1 / dir.z()};
+
+    float best = inf;
+    std::vector<std::pair<uint32_t, float>> stack = {{0, 0}};
+    while (!stack.empty())
+    {
+        const auto top = stack.back();
+        stack.pop_back();
+        if (top.second >= best)
+        {
+            continue;
+        }
+
+        const Node& n = nodes[top.first];
+        if (n.count)
+        {
+            for (uint32_t i=n.start; i < n.start + n.count; ++i)
+            {
+                const float t = ray_triangle(origin, dir, corner(tris[i], 0),
+                                             corner(tris[i], 1),
+                                             corner(tris[i], 2));
+                if (t < best)
+                {
+                    best = t;
+                    hit.triangle = tris[i];
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first, so the farther one can often be
+        // skipped once something has been hit
+        const uint32_t left = top.first + 1;
+        const uint32_t right = n.start;
+        const float tl = ray_box(nodes[left].lower, nodes[left].upper,
+                                 origin, inv_dir);
+        const float tr = ray_box(nodes[right].lower, nodes[right].upper,
+                                 origin, inv_dir);
+        if (tl < tr)
+        {
+            if (tr < best) stack.push_back({right, tr});
+            if (tl < best) stack.push_back({left, tl});
+        }
+        else
+        {
+            if (tl < best) stack.push_back({left, tl});
+            if (tr < best) stack.push_back({right, tr});
+        }
+    }
+
+    if (best == inf)
+    {
+        return false;
+    }
+    hit.distance = best;
+    hit.point = origin + dir * best;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*  Squared distance from p to a box (zero inside it) */
+static float box_distance2(const float* lower, const float* upper,
+                           const QVector3D& p)
+{
+    float d2 = 0;
+    for (int i=0; i < 3; ++i)
+    {
+        const float d = fmax(fmax(lower[i] - p[i], 0), p[i] - upper[i]);
+        d2 += d * d;
+    }
+    return d2;
+}
+
+/*  Closest point to p on a triangle, working through its Voronoi regions
+ *  (following Ericson, Real-Time Collision Detection, 5.1.5) */
+static QVector3D closest_point(const QVector3D& p, const QVector3D& a,
+                               const QVector3D& b, const QVector3D& c)
+{
+    const QVector3D ab = b - a;
+    const QVector3D ac = c - a;
+    const QVector3D ap = p - a;
+    const float d1 = QVector3D::dotProduct(ab, ap);
+    const float d2 = QVector3D::dotProduct(ac, ap);
+    if (d1 <= 0 && d2 <= 0)
+    {
+        return a;
+    }
+
+    const QVector3D bp = p - b;
+    const float d3 = QVector3D::dotProduct(ab, bp);
+    const float d4 = QVector3D::dotProduct(ac, bp);
+    if (d3 >= 0 && d4 <= d3)
+    {
+        return b;
+    }
+
+    const float vc = d1*d4 - d3*d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0)
+    {
+        return a + ab * (d1 / (d1 - d3));
+    }
+
+    const QVector3D cp = p - c;
+    const float d5 = QVector3D::dotProduct(ab, cp);
+    const float d6 = QVector3D::dotProduct(ac, cp);
+    if (d6 >= 0 && d5 <= d6)
+    {
+        return c;
+    }
+
+    const float vb = d5*d2 - d1*d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0)
+    {
+        return a + ac * (d2 / (d2 - d6));
+    }
+
+    const float va = d3*d6 - d5*d4;
+    if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+    {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    // Inside the face (degenerate triangles fall back to a corner)
+    const float sum = va + vb + vc;
+    if (sum == 0)
+    {
+        return a;
+    }
+    return a + ab * (vb / sum) + ac * (vc / sum);
+}
+
+bool Bvh::nearest(const QVector3D& p, Hit& hit) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    float best = inf;
+    std::vector<std::pair<uint32_t, float>> stack = {{0, 0}};
+    while (!stack.empty())
+    {
+        const auto top = stack.back();
+        stack.pop_back();
+        if (top.second >= best)
+        {
+            continue;
+        }
+
+        const Node& n = nodes[top.first];
+        if (n.count)
+        {
+            for (uint32_t i=n.start; i < n.start + n.count; ++i)
+            {
+                const QVector3D q = closest_point(p, corner(tris[i], 0),
+                                                  corner(tris[i], 1),
+                                                  corner(tris[i], 2));
+                const float d2 = (q - p).lengthSquared();
+                if (d2 < best)
+                {
+                    best = d2;
+                    hit.triangle = tris[i];
+                    hit.point = q;
+                }
+            }
+            continue;
+        }
+
+        const uint32_t left = top.first + 1;
+        const uint32_t right = n.start;
+        const float dl = box_distance2(nodes[left].lower, nodes[left].upper, p);
+        const float dr = box_distance2(nodes[right].lower, nodes[right].upper, p);
+        if (dl < dr)
+        {
+            if (dr < best) stack.push_back({right, dr});
+            if (dl < best) stack.push_back({left, dl});
+        }
+        else
+        {
+            if (dl < best) stack.push_back({left, dl});
+            if (dr < best) stack.push_back({right, dr});
+        }
+    }
+
+    hit.distance = std::sqrt(best);
+    return true;
+}
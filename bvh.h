@@ -0,0 +1,71 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <QVector3D>
+
+#include <vector>
+
+#include "mesh.h"
+
+/*
+ *  A bounding volume hierarchy over a mesh's triangles, for finding the
+ *  geometry under the cursor without testing every triangle.  Nodes are
+ *  split with a binned surface area heuristic, and the top of the tree
+ *  is built in parallel.
+ *
+ *  The hierarchy refers to the mesh's vertices and indices rather than
+ *  copying them, and holds on to the mesh to keep them alive.
+ */
+class Bvh
+{
+public:
+    explicit Bvh(MeshPtr mesh);
+
+    struct Hit
+    {
+        uint32_t triangle;
+        /*  Along the ray (in multiples of its direction), or from the
+         *  query point */
+        float distance;
+        QVector3D point;
+    };
+
+    /*  Finds the first triangle hit by a ray, returning false on a miss */
+    bool raycast(const QVector3D& origin, const QVector3D& dir, Hit& hit) const;
+
+    /*  Finds the closest point to p on the mesh's surface */
+    bool nearest(const QVector3D& p, Hit& hit) const;
+
+    size_t node_count() const { return nodes.size(); }
+
+private:
+    struct Node
+    {
+        float lower[3];
+        float upper[3];
+
+        /*  Leaves hold count triangles, listed from tris[start] onwards.
+         *  Interior nodes have a count of zero, their left child right
+         *  after them and their right child at nodes[start]. */
+        uint32_t start;
+        uint32_t count;
+    };
+
+    /*  Builds the subtree for tris[begin, end) onto the end of out */
+    void build(std::vector<Node>& out, uint32_t begin, uint32_t end,
+               unsigned threads, const std::vector<float>& centroids);
+
+    Bounds triangle_bounds(uint32_t t) const;
+    QVector3D corner(uint32_t t, int i) const;
+
+    const MeshPtr mesh;
+    const std::vector<GLfloat>& vertices;
+    const std::vector<GLuint>& indices;
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> tris;
+};
+
+typedef std::shared_ptr<const Bvh> BvhPtr;
+
+#endif // BVH_H
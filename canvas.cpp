@@ -5,8 +5,10 @@
 
 #include "canvas.h"
 #include "backdrop.h"
+#include "bvh.h"
 #include "glmesh.h"
 #include "mesh.h"
+#include "trace.h"
 
 Canvas::Canvas(const QSurfaceFormat &format, QWidget *parent)
     : QOpenGLWidget(parent), mesh(nullptr), scale(1), zoom(1), tilt(90), yaw(0),
@@ -19,12 +21,27 @@ Canvas::Canvas(const QSurfaceFormat &format, QWidget *parent)
     setStyleSheet(styleFile.readAll());
 
     anim.setDuration(100);
+
+    // Track the mouse without any buttons held, to show what's under it
+    setMouseTracking(true);
+
+    lod_timer.setSingleShot(true);
+    lod_timer.setInterval(200);
+    connect(&lod_timer, &QTimer::timeout, [=] {
+        moving = false;
+        update();
+    });
 }
 
 Canvas::~Canvas()
 {
 	makeCurrent();
 	delete mesh;
+	for (auto m : preview)
+	{
+		delete m;
+	}
+	frame_query.destroy();
 	doneCurrent();
 }
 
@@ -94,37 +111,140 @@ void Canvas::setCameraAngle(const enum Direction direction)
         break;
     }
 
+    repick();
     update();
 }
 
-void Canvas::load_mesh(Mesh* m, bool is_reload)
+void Canvas::frame_mesh(const Mesh* m)
+{
+    QVector3D lower(m->xmin(), m->ymin(), m->zmin());
+    QVector3D upper(m->xmax(), m->ymax(), m->zmax());
+    meshCenter = (lower + upper) / 2;
+    meshScale = 2 / (upper - lower).length();
+
+    reset_cam();
+}
+
+void Canvas::load_mesh(MeshPtr m, bool is_reload, bool exact)
 {
-    mesh = new GLMesh(m);
+    Trace::Span span("Canvas::load_mesh");
+    clear_preview();
+
+    // Reuse the previous mesh's buffers where possible, rather than
+    // leaking them on every reload
+    QElapsedTimer timer;
+    timer.start();
+    makeCurrent();
+    if (mesh)
+    {
+        mesh->load(m.get(), exact);
+    }
+    else
+    {
+        mesh = new GLMesh(m.get(), exact);
+    }
+    doneCurrent();
+    upload_ms = timer.nsecsElapsed() / 1e6;
 
     if (!is_reload)
     {
-        QVector3D lower(m->xmin(), m->ymin(), m->zmin());
-        QVector3D upper(m->xmax(), m->ymax(), m->zmax());
-        meshCenter = (lower + upper) / 2;
-        meshScale = 2 / (upper - lower).length();
+        frame_mesh(m.get());
+    }
+
+    // The new mesh gets its own hierarchy later on, see load_bvh
+    bvh.reset();
+    pick_status.clear();
+
+    update();
+}
+
+void Canvas::load_lods(LodsPtr lods)
+{
+    if (!mesh)
+    {
+        return;
+    }
+    makeCurrent();
+    mesh->load_lods(*lods);
+    doneCurrent();
+
+    // Only a moving camera draws them
+    if (moving)
+    {
+        update();
+    }
+}
+
+void Canvas::load_bvh(BvhPtr b)
+{
+    bvh = b;
+    repick();
+}
 
-        reset_cam();
+void Canvas::load_preview(Mesh* m, bool is_reload)
+{
+    // Frame the camera around the first batch, since it's usually a
+    // decent sample of the whole part
+    if (preview.empty() && !is_reload)
+    {
+        frame_mesh(m);
     }
 
+    makeCurrent();
+    preview.push_back(new GLMesh(m));
+    doneCurrent();
+
     update();
 
     delete m;
 }
 
+void Canvas::clear_preview()
+{
+    if (preview.empty())
+    {
+        return;
+    }
+
+    makeCurrent();
+    for (auto m : preview)
+    {
+        delete m;
+    }
+    doneCurrent();
+    preview.clear();
+
+    update();
+}
+
 void Canvas::set_status(const QString &s)
 {
     status = s;
     update();
 }
 
+void Canvas::set_hud(bool enabled)
+{
+    hud = enabled;
+    update();
+}
+
+void Canvas::set_load_stats(const LoadStats& stats)
+{
+    load_stats = stats;
+    update();
+}
+
+void Canvas::set_render_time(qint64 ms)
+{
+    render_ms = ms;
+    update();
+}
+
 void Canvas::set_perspective(float p)
 {
     perspective = p;
+    repick();
     update();
 }
 
@@ -192,26 +312,114 @@ void Canvas::initializeGL()
 
 
     backdrop = new Backdrop();
+
+    // Timer queries need GL 3.3 or ARB_timer_query, so this may fail, in
+    // which case the HUD falls back to CPU timing
+    frame_query.create();
 }
 
 
 void Canvas::paintGL()
 {
+	Trace::Span span("Canvas::paintGL");
+	QElapsedTimer timer;
+	const bool gpu_timing = hud && frame_query.isCreated();
+	if (gpu_timing && frame_query_pending && frame_query.isResultAvailable())
+	{
+		frame_ms = frame_query.waitForResult() / 1e6;
+		frame_query_pending = false;
+	}
+	const bool timing = gpu_timing && !frame_query_pending;
+	if (timing)
+	{
+		frame_query.begin();
+	}
+	timer.start();
+
 	glClearColor(0.0, 0.0, 0.0, 0.0);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glEnable(GL_DEPTH_TEST);
 
 	backdrop->draw();
-	if (mesh)  draw_mesh();
+	if (mesh || !preview.empty())  draw_mesh();
 
 	draw_small_axes();
 
-	if (status.isNull())  return;
+	if (!status.isNull() || hud)
+	{
+		draw_overlay();
+	}
+
+	// The overlay is timed too, since the painter's GL commands are part
+	// of the frame; the HUD drawn here shows the previous frame's time
+	if (timing)
+	{
+		frame_query.end();
+		frame_query_pending = true;
+	}
+	else if (!gpu_timing)
+	{
+		frame_ms = timer.nsecsElapsed() / 1e6;
+	}
+}
 
+void Canvas::draw_overlay()
+{
 	QPainter painter(this);
 	painter.setRenderHint(QPainter::Antialiasing);
 	painter.setPen(Qt::white);
 	painter.drawText(10, height() - 10, status);
+	if (!pick_status.isEmpty())
+	{
+		painter.drawText(10, height() - 10 - painter.fontMetrics().height(),
+		                 pick_status);
+	}
+	if (hud)
+	{
+		draw_hud(painter);
+	}
+}
+
+void Canvas::draw_hud(QPainter& painter)
+{
+    GLsizei triangles = 0;
+    if (mesh)
+    {
+        triangles = mesh->triangle_count(lod);
+    }
+    else
+    {
+        for (auto m : preview)
+        {
+            triangles += m->triangle_count();
+        }
+    }
+
+    QStringList lines;
+    lines << QString("Frame: %1 ms (%2)").arg(frame_ms, 0, 'f', 2)
+                 .arg(frame_query.isCreated() ? "GPU" : "CPU")
+          << QString("Triangles: %1 (level of detail %2)").arg(triangles)
+                 .arg(lod)
+          << QString("GPU buffers: %1 MB").arg(GLMesh::gpu_bytes() / 1e6,
+                                               0, 'f', 1)
+          << QString("Load: parse %1 ms, sort %2 ms, dedup %3 ms, "
+                     "upload %4 ms")
+                 .arg(load_stats.parse_ms, 0, 'f', 1)
+                 .arg(load_stats.sort_ms, 0, 'f', 1)
+                 .arg(load_stats.dedup_ms, 0, 'f', 1)
+                 .arg(upload_ms, 0, 'f', 1);
+    if (load_stats.wait_ms > 0)
+    {
+        lines << QString("Load: waiting for extopenscad %1 ms")
+                     .arg(load_stats.wait_ms, 0, 'f', 1);
+    }
+    if (render_ms >= 0)
+    {
+        lines << QString("extopenscad: %1 s").arg(render_ms / 1000.0, 0, 'f', 2);
+    }
+
+    painter.drawText(rect().adjusted(10, 10, -10, -10),
+                     Qt::AlignLeft | Qt::AlignTop, lines.join('\n'));
 }
 
 void Canvas::draw_mesh()
@@ -245,9 +453,31 @@ void Canvas::draw_mesh()
     // Find and enable the attribute location for vertex position
     const GLuint vp = selected_mesh_shader->attributeLocation("vertex_position");
     glEnableVertexAttribArray(vp);
+    const GLint offset_loc = selected_mesh_shader->uniformLocation("vertex_offset");
+    const GLint scale_loc = selected_mesh_shader->uniformLocation("vertex_scale");
 
-    // Then draw the mesh with that vertex position
-    mesh->draw(vp);
+    // Then draw the mesh with that vertex position (or, while it's still
+    // loading, whatever preview batches have arrived so far)
+    if (mesh)
+    {
+        lod = 0;
+        if (moving)
+        {
+            while (lod + 1 < mesh->lod_count() &&
+                   mesh->triangle_count(lod) > lod_budget)
+            {
+                lod++;
+            }
+        }
+        mesh->draw(vp, offset_loc, scale_loc, lod);
+    }
+    else
+    {
+        for (auto m : preview)
+        {
+            m->draw(vp, offset_loc, scale_loc);
+        }
+    }
 
     // Reset draw mode for the background and anything else that needs to be drawn
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -344,12 +574,17 @@ void Canvas::mouseMoveEvent(QMouseEvent* event)
     auto p = event->pos();
     auto d = p - mouse_pos;
 
+    if (!event->buttons())
+    {
+        pick(p);
+    }
+
 
     if (event->buttons() & Qt::LeftButton)
     {
         yaw = fmod(yaw - d.x(), 360);
         tilt = fmod(tilt - d.y(), 360);
-        update();
+        start_moving();
     }
     else if (event->buttons() & Qt::RightButton)
     {
@@ -357,7 +592,7 @@ void Canvas::mouseMoveEvent(QMouseEvent* event)
                  view_matrix().inverted() *
                  QVector3D(-d.x() / (0.5*width()),
                             d.y() / (0.5*height()), 0);
-        update();
+        start_moving();
     }
     mouse_pos = p;
 }
@@ -392,6 +627,70 @@ void Canvas::wheelEvent(QWheelEvent *event)
     QVector3D b = transform_matrix().inverted() *
                   view_matrix().inverted() * v;
     center += b - a;
+    start_moving();
+}
+
+void Canvas::leaveEvent(QEvent* event)
+{
+    Q_UNUSED(event);
+    if (!pick_status.isEmpty())
+    {
+        pick_status.clear();
+        update();
+    }
+}
+
+void Canvas::pick(const QPoint& pos)
+{
+    QString s;
+    if (bvh)
+    {
+        // Unproject the cursor onto the near and far clipping planes, and
+        // cast a ray between them
+        const QMatrix4x4 inv = (view_matrix() * transform_matrix()).inverted();
+        const float x = 2.0f * pos.x() / width() - 1;
+        const float y = 1 - 2.0f * pos.y() / height();
+        const QVector3D front = inv.map(QVector3D(x, y, -1));
+        const QVector3D back = inv.map(QVector3D(x, y, 1));
+
+        Bvh::Hit hit;
+        if (bvh->raycast(front, back - front, hit))
+        {
+            s = QString("%1, %2, %3 (triangle %4)")
+                    .arg(hit.point.x(), 0, 'f', 3)
+                    .arg(hit.point.y(), 0, 'f', 3)
+                    .arg(hit.point.z(), 0, 'f', 3)
+                    .arg(hit.triangle);
+        }
+    }
+
+    // Only repaint when the text actually changes, since the mouse moves
+    // far more often than that
+    if (s != pick_status)
+    {
+        pick_status = s;
+        update();
+    }
+}
+
+void Canvas::repick()
+{
+    if (underMouse())
+    {
+        pick(mapFromGlobal(QCursor::pos()));
+    }
+    else if (!pick_status.isEmpty())
+    {
+        pick_status.clear();
+        update();
+    }
+}
+
+void Canvas::start_moving()
+{
+    moving = true;
+    lod_timer.start();
+    repick();
     update();
 }
 
@@ -4,6 +4,11 @@
 #include <QtOpenGL>
 #include <QSurfaceFormat>
 #include <QOpenGLShaderProgram>
+#include <QOpenGLTimerQuery>
+
+#include <vector>
+
+#include "loader.h"
 
 class GLMesh;
 class Mesh;
@@ -28,10 +33,24 @@ public:
 public slots:
     void set_status(const QString& s);
     void clear_status();
-    void load_mesh(Mesh* m, bool is_reload);
+    /*  Final renders pass exact, so that their positions are never
+     *  quantized on the GPU */
+    void load_mesh(MeshPtr m, bool is_reload, bool exact=false);
+    /*  Adds levels of detail to the mesh from the last load_mesh */
+    void load_lods(LodsPtr lods);
+    /*  Enables picking on the mesh from the last load_mesh */
+    void load_bvh(BvhPtr bvh);
+    void load_preview(Mesh* m, bool is_reload);
+    void clear_preview();
     void reset_cam();
     void setCameraAngle(const enum Direction direction);
 
+    /*  Shows or hides the performance overlay */
+    void set_hud(bool enabled);
+    void set_load_stats(const LoadStats& stats);
+    /*  Records how long extopenscad took for the last render */
+    void set_render_time(qint64 ms);
+
 protected:
 	void paintGL() override;
 	void initializeGL() override;
@@ -41,6 +60,7 @@ protected:
     void mouseReleaseEvent(QMouseEvent* event) override;
     void mouseMoveEvent(QMouseEvent* event) override;
     void wheelEvent(QWheelEvent* event) override;
+    void leaveEvent(QEvent* event) override;
     
 	void set_perspective(float p);
     void set_renderMode(const enum RenderMode);
@@ -48,7 +68,21 @@ protected:
 
 private:
     void draw_mesh();
+    void frame_mesh(const Mesh* m);
     void draw_small_axes();
+    void draw_hud(QPainter& painter);
+
+    /*  Draws the status line and HUD over the scene */
+    void draw_overlay();
+
+    /*  Called on camera input, to draw a coarser level of detail until
+     *  the input stops */
+    void start_moving();
+
+    /*  Finds what's under the cursor, for the status overlay */
+    void pick(const QPoint& pos);
+    /*  Picks again after the camera has moved under the cursor */
+    void repick();
 
     QMatrix4x4 transform_matrix() const;
     QMatrix4x4 view_matrix() const;
@@ -62,6 +96,13 @@ private:
     QOpenGLBuffer small_axes_vertices;
 
     GLMesh* mesh;
+
+    /*  Picking hierarchy for the displayed mesh, if one has arrived */
+    BvhPtr bvh;
+    QString pick_status;
+
+    /*  Batches of raw triangles shown while a mesh is still loading */
+    std::vector<GLMesh*> preview;
     Backdrop* backdrop;
 
     QVector3D center;
@@ -79,6 +120,26 @@ private:
 
     QPoint mouse_pos;
     QString status;
+
+    /*  While the camera is moving, the mesh is drawn at the finest level
+     *  of detail that fits in lod_budget triangles (or the coarsest one
+     *  there is), switching back once lod_timer runs out */
+    bool moving = false;
+    QTimer lod_timer;
+    int lod = 0;
+
+    /*  Performance overlay.  Frame times come from a GL timer query when
+     *  the driver has one, and otherwise from the CPU side of paintGL
+     *  (which doesn't wait for the GPU to finish).  The query is read
+     *  back on a later frame, once its result is available, so that it
+     *  never stalls the pipeline. */
+    bool hud = false;
+    QOpenGLTimerQuery frame_query;
+    bool frame_query_pending = false;
+    double frame_ms = 0;
+    LoadStats load_stats;
+    double upload_ms = 0;
+    qint64 render_ms = -1;
 };
 
 #endif // CANVAS_H
@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <future>
+
+#include "dedup.h"
+#include "vertex.h"
+
+DedupMethod dedup_method_from_name(const QString& name)
+{
+    if (name == "sort")         return DedupMethod::Sort;
+    else if (name == "hash")    return DedupMethod::Hash;
+    else                        return DedupMethod::Radix;
+}
+
+QString dedup_method_name(DedupMethod method)
+{
+    switch (method)
+    {
+        case DedupMethod::Sort: return "sort";
+        case DedupMethod::Hash: return "hash";
+        case DedupMethod::Radix: break;
+    }
+    return "radix";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*  Returns the raw bits of a coordinate, with -0 folded onto +0 so that
+ *  the table agrees with Vertex::operator!= */
+static inline uint32_t coord_bits(float f)
+{
+    uint32_t b;
+    memcpy(&b, &f, sizeof(b));
+    return (b == 0x80000000u) ? 0 : b;
+}
+
+static inline uint64_t vertex_hash(const Vertex& v)
+{
+    uint64_t h = coord_bits(v.x);
+    h = (h * 0x9E3779B97F4A7C15ull) ^ coord_bits(v.y);
+    h = (h * 0xC2B2AE3D27D4EB4Full) ^ coord_bits(v.z);
+    h ^= h >> 29;
+    h *= 0x165667B19E3779F9ull;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline bool same_bits(const Vertex& a, const Vertex& b)
+{
+    return coord_bits(a.x) == coord_bits(b.x) &&
+           coord_bits(a.y) == coord_bits(b.y) &&
+           coord_bits(a.z) == coord_bits(b.z);
+}
+
+/*  Runs f(0) ... f(threads - 1), each on its own thread */
+template <typename F>
+static void run_workers(unsigned threads, F f)
+{
+    std::vector<std::future<void>> futures;
+    for (unsigned t=1; t < threads; ++t)
+    {
+        futures.push_back(std::async(std::launch::async, f, t));
+    }
+    f(0);
+    for (auto& future : futures)
+    {
+        future.wait();
+    }
+}
+
+/*  Maps a coordinate onto an unsigned key with the same ordering, and back
+ *  again.  The key is stored in place of the float's bits while sorting. */
+static inline void to_sort_key(GLfloat& f)
+{
+    uint32_t b = coord_bits(f);
+    b = (b & 0x80000000u) ? ~b : (b | 0x80000000u);
+    memcpy(&f, &b, sizeof(b));
+}
+
+static inline void from_sort_key(GLfloat& f)
+{
+    uint32_t b;
+    memcpy(&b, &f, sizeof(b));
+    b = (b & 0x80000000u) ? (b & 0x7FFFFFFFu) : ~b;
+    memcpy(&f, &b, sizeof(b));
+}
+
+/*  Returns the given byte of a keyed vertex's 96-bit (x, y, z) key, where
+ *  byte 0 is the least significant */
+static inline uint32_t key_byte(const Vertex& v, unsigned byte)
+{
+    const GLfloat& f = (byte < 4) ? v.z : (byte < 8) ? v.y : v.x;
+    uint32_t b;
+    memcpy(&b, &f, sizeof(b));
+    return (b >> ((byte % 4) * 8)) & 0xFF;
+}
+
+void radix_sort(Vertex* begin, Vertex* end, unsigned threads)
+{
+    const size_t count = end - begin;
+    if (count < 4096)
+    {
+        std::sort(begin, end);
+        return;
+    }
+    if (count < (1 << 16))
+    {
+        threads = 1;
+    }
+
+    const auto range = [=](unsigned t) {
+        return std::make_pair(count * t / threads, count * (t + 1) / threads);
+    };
+
+    // Convert coordinates to keys, counting every digit along the way.
+    // Digit histograms don't depend on order, so this also tells us which
+    // passes have the same digit for all keys and can be skipped.
+    std::vector<std::array<size_t, 12 * 256>> hist(threads);
+    run_workers(threads, [&](unsigned t) {
+        auto& h = hist[t];
+        h.fill(0);
+        const auto r = range(t);
+        for (Vertex* v=begin + r.first; v != begin + r.second; ++v)
+        {
+            to_sort_key(v->x);
+            to_sort_key(v->y);
+            to_sort_key(v->z);
+            for (unsigned byte=0; byte < 12; ++byte)
+            {
+                h[byte * 256 + key_byte(*v, byte)]++;
+            }
+        }
+    });
+
+    std::vector<Vertex> scratch(count);
+    Vertex* src = begin;
+    Vertex* dst = scratch.data();
+    std::vector<std::array<size_t, 256>> offsets(threads);
+
+    for (unsigned byte=0; byte < 12; ++byte)
+    {
+        size_t total[256] = {0};
+        for (unsigned t=0; t < threads; ++t)
+        {
+            for (unsigned d=0; d < 256; ++d)
+            {
+                total[d] += hist[t][byte * 256 + d];
+            }
+        }
+        if (std::find(total, total + 256, count) != total + 256)
+        {
+            continue;
+        }
+
+        // Count this pass's digits in each thread's slice of the current
+        // order (unless there's only one slice, which the totals cover),
+        // then turn the counts into stable scatter offsets
+        if (threads == 1)
+        {
+            std::copy(total, total + 256, offsets[0].begin());
+        }
+        else
+        {
+            run_workers(threads, [&](unsigned t) {
+                auto& o = offsets[t];
+                o.fill(0);
+                const auto r = range(t);
+                for (size_t i=r.first; i < r.second; ++i)
+                {
+                    o[key_byte(src[i], byte)]++;
+                }
+            });
+        }
+        size_t sum = 0;
+        for (unsigned d=0; d < 256; ++d)
+        {
+            for (unsigned t=0; t < threads; ++t)
+            {
+                const size_t c = offsets[t][d];
+                offsets[t][d] = sum;
+                sum += c;
+            }
+        }
+
+        run_workers(threads, [&](unsigned t) {
+            auto& o = offsets[t];
+            const auto r = range(t);
+            for (size_t i=r.first; i < r.second; ++i)
+            {
+                dst[o[key_byte(src[i], byte)]++] = src[i];
+            }
+        });
+        std::swap(src, dst);
+    }
+
+    // Turn keys back into coordinates, moving the result out of the
+    // scratch buffer if it ended up there after an odd number of passes
+    run_workers(threads, [&](unsigned t) {
+        const auto r = range(t);
+        for (size_t i=r.first; i < r.second; ++i)
+        {
+            Vertex v = src[i];
+            from_sort_key(v.x);
+            from_sort_key(v.y);
+            from_sort_key(v.z);
+            begin[i] = v;
+        }
+    });
+}
+
+void hash_dedup(const Vertex* verts, size_t count, unsigned threads,
+                std::vector<GLfloat>& flat_verts,
+                std::vector<GLuint>& indices, Bounds& bounds)
+{
+    indices.resize(count);
+
+    // Small meshes aren't worth the cost of spinning up threads
+    if (count < (1 << 16))
+    {
+        threads = 1;
+    }
+
+    // Use a few shards per thread so that uneven shards balance out
+    unsigned shard_bits = 0;
+    while ((1u << shard_bits) < threads * 4 && shard_bits < 10)
+    {
+        shard_bits++;
+    }
+    const size_t shards = size_t(1) << shard_bits;
+    const auto shard_of = [=](const Vertex& v) {
+        return shard_bits ? size_t(vertex_hash(v) >> (64 - shard_bits)) : 0;
+    };
+    const auto range = [=](unsigned t) {
+        return std::make_pair(count * t / threads, count * (t + 1) / threads);
+    };
+
+    // Count how many vertices from each thread's range land in each shard
+    std::vector<size_t> offsets(threads * shards);
+    run_workers(threads, [&](unsigned t) {
+        size_t* c = &offsets[t * shards];
+        const auto r = range(t);
+        for (size_t i=r.first; i < r.second; ++i)
+        {
+            c[shard_of(verts[i])]++;
+        }
+    });
+
+    // Turn the counts into write offsets, so that every shard's vertices
+    // end up contiguous and in their original order
+    std::vector<size_t> shard_start(shards + 1);
+    size_t total = 0;
+    for (size_t s=0; s < shards; ++s)
+    {
+        shard_start[s] = total;
+        for (unsigned t=0; t < threads; ++t)
+        {
+            const size_t c = offsets[t * shards + s];
+            offsets[t * shards + s] = total;
+            total += c;
+        }
+    }
+    shard_start[shards] = total;
+
+    std::vector<GLuint> order(count);
+    run_workers(threads, [&](unsigned t) {
+        size_t* o = &offsets[t * shards];
+        const auto r = range(t);
+        for (size_t i=r.first; i < r.second; ++i)
+        {
+            order[o[shard_of(verts[i])]++] = i;
+        }
+    });
+
+    // Build each shard's table, storing a shard-local vertex index in
+    // indices and remembering the first occurrence of every vertex
+    std::vector<std::vector<GLuint>> unique(shards);
+    std::atomic<size_t> next_shard(0);
+    run_workers(threads, [&](unsigned) {
+        // Slots hold (first occurrence + 1), so zero marks an empty slot
+        std::vector<GLuint> table;
+        for (size_t s; (s = next_shard++) < shards;)
+        {
+            const size_t n = shard_start[s + 1] - shard_start[s];
+            size_t capacity = 16;
+            while (capacity < n * 2)
+            {
+                capacity *= 2;
+            }
+            const size_t mask = capacity - 1;
+            table.assign(capacity, 0);
+
+            auto& u = unique[s];
+            for (size_t k=shard_start[s]; k < shard_start[s + 1]; ++k)
+            {
+                const GLuint i = order[k];
+                const Vertex& v = verts[i];
+                size_t slot = vertex_hash(v) & mask;
+                while (table[slot] && !same_bits(verts[table[slot] - 1], v))
+                {
+                    slot = (slot + 1) & mask;
+                }
+                if (!table[slot])
+                {
+                    table[slot] = i + 1;
+                    u.push_back(i);
+                }
+                // The first occurrence's index is final by the time any
+                // duplicates of it are visited, since order is stable.
+                indices[i] = (table[slot] - 1 == i) ? u.size() - 1
+                                                    : indices[table[slot] - 1];
+            }
+        }
+    });
+
+    // Lay the shards out one after another in the output array
+    std::vector<size_t> base(shards + 1);
+    for (size_t s=0; s < shards; ++s)
+    {
+        base[s + 1] = base[s] + unique[s].size();
+    }
+    flat_verts.resize(base[shards] * 3);
+
+    std::vector<Bounds> partial(threads);
+    next_shard = 0;
+    run_workers(threads, [&](unsigned t) {
+        for (size_t s; (s = next_shard++) < shards;)
+        {
+            GLfloat* out = flat_verts.data() + base[s] * 3;
+            for (const GLuint i : unique[s])
+            {
+                *out++ = verts[i].x;
+                *out++ = verts[i].y;
+                *out++ = verts[i].z;
+                partial[t].add(out - 3);
+            }
+            for (size_t k=shard_start[s]; k < shard_start[s + 1]; ++k)
+            {
+                indices[order[k]] += base[s];
+            }
+        }
+    });
+
+    for (const auto& b : partial)
+    {
+        bounds.add(b);
+    }
+}
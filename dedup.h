@@ -0,0 +1,43 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <QString>
+#include <QtOpenGL/QtOpenGL>
+
+#include <vector>
+
+#include "mesh.h"
+
+struct Vertex;
+
+/*
+ *  Strategies for merging identical vertices when building an indexed mesh
+ */
+enum class DedupMethod { Sort, Radix, Hash };
+
+/*  Converts to and from the names used in the settings file */
+DedupMethod dedup_method_from_name(const QString& name);
+QString dedup_method_name(DedupMethod method);
+
+/*
+ *  Sorts vertices into the same order as Vertex::operator<, using an LSD
+ *  radix sort over order-preserving 96-bit integer keys.  Each pass is
+ *  split across up to threads workers, and passes where every key has
+ *  the same digit are skipped.  Coordinates of -0 come back as +0.
+ */
+void radix_sort(Vertex* begin, Vertex* end, unsigned threads);
+
+/*
+ *  Deduplicates count vertices with open-addressing hash tables keyed on
+ *  their raw xyz bits.  Vertices are partitioned into shards by hash, and
+ *  each shard's table is built by one of up to threads workers.
+ *
+ *  Unique vertices are written as xyz triples into flat_verts, the new
+ *  index of every input vertex is written into indices, and bounds is
+ *  filled in while the unique vertices are written out.
+ */
+void hash_dedup(const Vertex* verts, size_t count, unsigned threads,
+                std::vector<GLfloat>& flat_verts,
+                std::vector<GLuint>& indices, Bounds& bounds);
+
+#endif // DEDUP_H
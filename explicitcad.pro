@@ -6,10 +6,10 @@ CONFIG      += qscintilla2
 #    QMAKE_POST_LINK = install_name_tool -change libqscintilla2_qt$${QT_MAJOR_VERSION}.13.dylib $$[QT_INSTALL_LIBS]/libqscintilla2_qt$${QT_MAJOR_VERSION}.13.dylib $(TARGET)
 #}
 
-HEADERS      = mainwindow.h backdrop.h glmesh.h mesh.h canvas.h loader.h preferences.h viewwidget.h
-SOURCES      = main.cpp mainwindow.cpp backdrop.cpp glmesh.cpp mesh.cpp loader.cpp canvas.cpp preferences.cpp tab.cpp
+HEADERS      = mainwindow.h backdrop.h glmesh.h mesh.h canvas.h loader.h preferences.h viewwidget.h dedup.h stlparser.h kernels.h meshcache.h meshfile.h renderscheduler.h batch.h trace.h simplify.h bvh.h
+SOURCES      = main.cpp mainwindow.cpp backdrop.cpp glmesh.cpp mesh.cpp loader.cpp canvas.cpp preferences.cpp tab.cpp dedup.cpp stlparser.cpp kernels.cpp meshcache.cpp meshfile.cpp renderscheduler.cpp batch.cpp trace.cpp simplify.cpp bvh.cpp
 RESOURCES    = explicitcad.qrc
 RESOURCES += gl/gl.qrc
 
 
-CONFIG += c++14
+CONFIG += c++17
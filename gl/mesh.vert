@@ -4,10 +4,14 @@ attribute vec3 vertex_position;
 uniform mat4 transform_matrix;
 uniform mat4 view_matrix;
 
+// Positions arrive as normalized 16-bit integers within the mesh's bounds
+uniform vec3 vertex_offset;
+uniform vec3 vertex_scale;
+
 varying vec3 ec_pos;
 
 void main() {
     gl_Position = view_matrix*transform_matrix*
-        vec4(vertex_position, 1.0);
+        vec4(vertex_offset + vertex_scale*vertex_position, 1.0);
     ec_pos = gl_Position.xyz;
 }
@@ -1,37 +1,185 @@
+#include <algorithm>
+#include <vector>
+
 #include "glmesh.h"
+#include "kernels.h"
 #include "mesh.h"
+#include "trace.h"
+
+qint64 GLMesh::total_bytes = 0;
+quint64 GLMesh::draw_count = 0;
 
-GLMesh::GLMesh(const Mesh* const mesh)
+GLMesh::GLMesh(const Mesh* const mesh, bool exact)
     : vertices(QOpenGLBuffer::VertexBuffer), indices(QOpenGLBuffer::IndexBuffer)
 {
     initializeOpenGLFunctions();
+    load(mesh, exact);
+}
+
+GLMesh::~GLMesh()
+{
+    // The buffers themselves are freed by QOpenGLBuffer, as long as the
+    // owner has made the right context current
+    total_bytes -= vertex_capacity + index_capacity;
+    for (const auto& lod : lods)
+    {
+        total_bytes -= lod.capacity;
+    }
+}
 
-    vertices.create();
-    indices.create();
+void GLMesh::upload(QOpenGLBuffer& buffer, qint64& capacity,
+                    const void* data, qint64 bytes)
+{
+    if (!buffer.isCreated())
+    {
+        buffer.create();
+        buffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    }
 
-    vertices.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    indices.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    buffer.bind();
+    if (bytes <= capacity && bytes >= capacity / 4)
+    {
+        // Orphan the old storage (so that we don't stall on draws that
+        // may still be using it), then write into the fresh storage.
+        buffer.allocate(capacity);
+        buffer.write(0, data, bytes);
+    }
+    else
+    {
+        // Grow, or shrink if most of the old storage would go unused
+        buffer.allocate(data, bytes);
+        total_bytes += bytes - capacity;
+        capacity = bytes;
+    }
+    buffer.release();
+}
 
-    vertices.bind();
-    vertices.allocate(mesh->vertices.data(),
-                      mesh->vertices.size() * sizeof(float));
-    vertices.release();
+void GLMesh::load(const Mesh* const mesh, bool exact)
+{
+    Trace::Span span("GLMesh::load");
+    vertex_count = mesh->vertices.size() / 3;
+    index_count = mesh->indices.size();
+
+    // Quantize positions relative to the bounding box.  An empty mesh has
+    // inverted bounds, so clamp its extent to zero.  Rounding moves a
+    // position by up to half a step of extent / 65535.
+    float quant_scale[3];
+    for (int i=0; i < 3; ++i)
+    {
+        const float extent = std::max(0.0f, mesh->bounds.upper[i] -
+                                            mesh->bounds.lower[i]);
+        offset[i] = vertex_count ? mesh->bounds.lower[i] : 0;
+        scale[i] = extent;
+        quant_scale[i] = (extent > 0) ? 65535 / extent : 0;
+        if (extent / 65535 / 2 > max_error)
+        {
+            exact = true;
+        }
+    }
 
-    indices.bind();
-    indices.allocate(mesh->indices.data(),
-                     mesh->indices.size() * sizeof(uint32_t));
-    indices.release();
+    if (exact)
+    {
+        vertex_type = GL_FLOAT;
+        for (int i=0; i < 3; ++i)
+        {
+            offset[i] = 0;
+            scale[i] = 1;
+        }
+        upload(vertices, vertex_capacity, mesh->vertices.data(),
+               mesh->vertices.size() * sizeof(GLfloat));
+    }
+    else
+    {
+        vertex_type = GL_UNSIGNED_SHORT;
+        std::vector<uint16_t> quantized(vertex_count * 4);
+        Kernels::quantize(mesh->vertices.data(), vertex_count, offset,
+                          quant_scale, quantized.data());
+        upload(vertices, vertex_capacity, quantized.data(),
+               quantized.size() * sizeof(uint16_t));
+    }
+
+    // Levels of detail are built later on, see load_lods
+    lod_levels = 0;
+
+    if (!index_count)
+    {
+        return;
+    }
+    index_type = (vertex_count <= 65536) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    upload_indices(indices, index_capacity, mesh->indices);
+}
+
+void GLMesh::load_lods(const std::vector<std::vector<GLuint>>& lod_indices)
+{
+    Trace::Span span("GLMesh::load_lods");
+
+    // Levels of detail left over from a larger set are freed
+    const size_t levels = index_count ? lod_indices.size() : 0;
+    for (size_t i=levels; i < lods.size(); ++i)
+    {
+        total_bytes -= lods[i].capacity;
+        lods[i].buffer.destroy();
+    }
+    lods.resize(levels);
+
+    for (size_t i=0; i < levels; ++i)
+    {
+        upload_indices(lods[i].buffer, lods[i].capacity, lod_indices[i]);
+        lods[i].count = lod_indices[i].size();
+    }
+    lod_levels = levels;
+}
+
+void GLMesh::upload_indices(QOpenGLBuffer& buffer, qint64& capacity,
+                            const std::vector<GLuint>& data)
+{
+    if (index_type == GL_UNSIGNED_SHORT)
+    {
+        std::vector<uint16_t> short_indices(data.begin(), data.end());
+        upload(buffer, capacity, short_indices.data(),
+               short_indices.size() * sizeof(uint16_t));
+    }
+    else
+    {
+        upload(buffer, capacity, data.data(), data.size() * sizeof(uint32_t));
+    }
 }
 
-void GLMesh::draw(GLuint vp)
+void GLMesh::draw(GLuint vp, GLint offset_loc, GLint scale_loc, int lod)
 {
+    glUniform3fv(offset_loc, 1, offset);
+    glUniform3fv(scale_loc, 1, scale);
+
+    draw_count++;
+
     vertices.bind();
-    indices.bind();
+    if (vertex_type == GL_FLOAT)
+    {
+        glVertexAttribPointer(vp, 3, GL_FLOAT, false, 3*sizeof(GLfloat), NULL);
+    }
+    else
+    {
+        glVertexAttribPointer(vp, 3, GL_UNSIGNED_SHORT, true,
+                              4*sizeof(uint16_t), NULL);
+    }
 
-    glVertexAttribPointer(vp, 3, GL_FLOAT, false, 3*sizeof(float), NULL);
-    glDrawElements(GL_TRIANGLES, indices.size() / sizeof(uint32_t),
-                   GL_UNSIGNED_INT, NULL);
+    if (lod)
+    {
+        QOpenGLBuffer& buffer = lods[lod - 1].buffer;
+        buffer.bind();
+        glDrawElements(GL_TRIANGLES, lods[lod - 1].count, index_type, NULL);
+        buffer.release();
+    }
+    else if (index_count)
+    {
+        indices.bind();
+        glDrawElements(GL_TRIANGLES, index_count, index_type, NULL);
+        indices.release();
+    }
+    else
+    {
+        glDrawArrays(GL_TRIANGLES, 0, vertex_count);
+    }
 
     vertices.release();
-    indices.release();
 }
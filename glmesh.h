@@ -4,17 +4,93 @@
 #include <QOpenGLBuffer>
 #include <QOpenGLFunctions>
 
+#include <vector>
+
 // forward declaration
 class Mesh;
 
 class GLMesh : protected QOpenGLFunctions
 {
 public:
-    GLMesh(const Mesh* const mesh);
-    void draw(GLuint vp);
+    GLMesh(const Mesh* const mesh, bool exact=false);
+    ~GLMesh();
+
+    /*  Replaces the contents of this GLMesh, reusing its buffers if the
+     *  new mesh fits in them.  Positions are quantized unless exact is
+     *  set or quantizing would move them by more than max_error. */
+    void load(const Mesh* const mesh, bool exact=false);
+
+    /*  Uploads simplified index lists over the loaded mesh's vertices (see
+     *  build_lods), replacing any levels of detail it had */
+    void load_lods(const std::vector<std::vector<GLuint>>& lod_indices);
+
+    /*  Largest quantization error (in model units) that's accepted for
+     *  a mesh's positions before falling back to floats */
+    static constexpr float max_error = 1e-3f;
+
+    /*  Draws the mesh, loading its dequantization parameters into the
+     *  vertex_offset and vertex_scale uniforms at the given locations.
+     *  Levels of detail above zero draw the mesh's simplified versions. */
+    void draw(GLuint vp, GLint offset_loc, GLint scale_loc, int lod=0);
+
+    /*  Number of levels of detail, including the full mesh */
+    int lod_count() const { return lod_levels + 1; }
+
+    GLsizei triangle_count(int lod=0) const
+    {
+        return lod ? lods[lod - 1].count / 3
+                   : (index_count ? index_count : vertex_count) / 3;
+    }
+
+    /*  Total size of the buffers held by every GLMesh */
+    static qint64 gpu_bytes() { return total_bytes; }
+
+    /*  Number of draw calls made by every GLMesh so far */
+    static quint64 draw_calls() { return draw_count; }
+
 private:
+    void upload(QOpenGLBuffer& buffer, qint64& capacity,
+                const void* data, qint64 bytes);
+    /*  Uploads indices as index_type */
+    void upload_indices(QOpenGLBuffer& buffer, qint64& capacity,
+                        const std::vector<GLuint>& data);
+
 	QOpenGLBuffer vertices;
 	QOpenGLBuffer indices;
+
+    /*  Allocated sizes of the buffers, which may be larger than what's in
+     *  use after loading a smaller mesh */
+    qint64 vertex_capacity = 0;
+    qint64 index_capacity = 0;
+
+    /*  Meshes without indices are drawn as a plain list of triangles */
+    GLsizei vertex_count;
+    GLsizei index_count;
+
+    /*  Simplified index buffers, which share the vertex buffer.  They're
+     *  kept for reuse when a new mesh is loaded, but only the first
+     *  lod_levels belong to the current one. */
+    struct Lod
+    {
+        QOpenGLBuffer buffer{QOpenGLBuffer::IndexBuffer};
+        qint64 capacity = 0;
+        GLsizei count = 0;
+    };
+    std::vector<Lod> lods;
+    int lod_levels = 0;
+
+    /*  Indices are stored as 16-bit values when every vertex fits, and
+     *  positions (as vertex_type) either as 16-bit integers normalized to
+     *  the mesh's bounding box or as plain floats.  The vertex shader maps
+     *  them back with offset + scale * position, where a float mesh has
+     *  no offset and unit scale. */
+    GLenum index_type;
+    GLenum vertex_type;
+    GLfloat offset[3];
+    GLfloat scale[3];
+
+    static qint64 total_bytes;
+    static quint64 draw_count;
 };
 
 #endif // GLMESH_H
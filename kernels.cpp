@@ -0,0 +1,434 @@
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 versions are compiled with per-function target attributes, so the
+// rest of the program doesn't need to be built with -mavx2.
+#if defined(KERNELS_SSE2) && defined(__GNUC__)
+#define KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+#include "kernels.h"
+
+namespace Kernels
+{
+
+namespace Scalar
+{
+
+static void bounds(const GLfloat* xyz, size_t count, Bounds& b)
+{
+    for (size_t i=0; i < count; ++i)
+    {
+        b.add(xyz + i*3);
+    }
+}
+
+static void deinterleave_stl(const uint8_t* r, size_t tri_count, Vertex* out)
+{
+    for (size_t t=0; t < tri_count; ++t)
+    {
+        // Skip this face's normal vector
+        r += 3 * sizeof(float);
+
+        for (unsigned i=0; i < 3; ++i)
+        {
+            memcpy(&out[i], r, 3 * sizeof(float));
+            r += 3 * sizeof(float);
+        }
+
+        // Skip face attribute
+        r += sizeof(uint16_t);
+        out += 3;
+    }
+}
+
+static void flatten(const Vertex* in, size_t count, GLfloat* xyz, Bounds& b)
+{
+    for (size_t i=0; i < count; ++i)
+    {
+        memcpy(xyz, &in[i], 3 * sizeof(GLfloat));
+        b.add(xyz);
+        xyz += 3;
+    }
+}
+
+static inline uint16_t quantize_one(float v, float offset, float scale)
+{
+    const float f = (v - offset) * scale + 0.5f;
+    if (!(f > 0))           return 0;
+    else if (f >= 65535)    return 65535;
+    else                    return uint16_t(f);
+}
+
+static void quantize(const GLfloat* xyz, size_t count, const float offset[3],
+                     const float scale[3], uint16_t* out)
+{
+    for (size_t i=0; i < count; ++i)
+    {
+        for (unsigned k=0; k < 3; ++k)
+        {
+            out[k] = quantize_one(xyz[k], offset[k], scale[k]);
+        }
+        out[3] = 0;
+        xyz += 3;
+        out += 4;
+    }
+}
+
+}   // namespace Scalar
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*  Folds min/max registers, whose lanes hold interleaved xyz values, into
+ *  b.  Lane j of the stored registers holds component j % 3. */
+static void reduce_interleaved(const float* lo, const float* hi, size_t lanes,
+                               Bounds& b)
+{
+    for (size_t j=0; j < lanes; ++j)
+    {
+        b.lower[j % 3] = fmin(b.lower[j % 3], lo[j]);
+        b.upper[j % 3] = fmax(b.upper[j % 3], hi[j]);
+    }
+}
+
+#ifdef KERNELS_SSE2
+namespace SSE2
+{
+
+static void bounds(const GLfloat* xyz, size_t count, Bounds& b)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+    __m128 lo[3], hi[3];
+    for (int k=0; k < 3; ++k)
+    {
+        lo[k] = _mm_set1_ps(inf);
+        hi[k] = _mm_set1_ps(-inf);
+    }
+
+    // Four vertices fill three registers exactly.  The new value goes
+    // first in min/max so that NaNs are skipped, as with fmin/fmax.
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        for (int k=0; k < 3; ++k)
+        {
+            const __m128 v = _mm_loadu_ps(xyz + i*3 + k*4);
+            lo[k] = _mm_min_ps(v, lo[k]);
+            hi[k] = _mm_max_ps(v, hi[k]);
+        }
+    }
+
+    float l[12], h[12];
+    for (int k=0; k < 3; ++k)
+    {
+        _mm_storeu_ps(l + k*4, lo[k]);
+        _mm_storeu_ps(h + k*4, hi[k]);
+    }
+    reduce_interleaved(l, h, 12, b);
+    Scalar::bounds(xyz + i*3, count - i, b);
+}
+
+static void deinterleave_stl(const uint8_t* r, size_t tri_count, Vertex* out)
+{
+    // Each 16-byte load picks up the vertex plus four more bytes, which
+    // land in the unused i field.  The last vertex's load runs past the
+    // end of its record, so the final triangle is left to the scalar code.
+    size_t t = 0;
+    for (; t + 1 < tri_count; ++t)
+    {
+        const float* f = reinterpret_cast<const float*>(r + 12);
+        _mm_storeu_ps(&out[0].x, _mm_loadu_ps(f));
+        _mm_storeu_ps(&out[1].x, _mm_loadu_ps(f + 3));
+        _mm_storeu_ps(&out[2].x, _mm_loadu_ps(f + 6));
+        r += 50;
+        out += 3;
+    }
+    Scalar::deinterleave_stl(r, tri_count - t, out);
+}
+
+static void flatten(const Vertex* in, size_t count, GLfloat* xyz, Bounds& b)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+    __m128 lo = _mm_set1_ps(inf);
+    __m128 hi = _mm_set1_ps(-inf);
+
+    // Each store also writes the i field, which the next vertex then
+    // overwrites, so the last vertex is left to the scalar code.
+    size_t i = 0;
+    for (; i + 1 < count; ++i)
+    {
+        const __m128 v = _mm_loadu_ps(&in[i].x);
+        _mm_storeu_ps(xyz + i*3, v);
+        lo = _mm_min_ps(v, lo);
+        hi = _mm_max_ps(v, hi);
+    }
+
+    float l[4], h[4];
+    _mm_storeu_ps(l, lo);
+    _mm_storeu_ps(h, hi);
+    reduce_interleaved(l, h, 3, b);
+    Scalar::flatten(in + i, count - i, xyz + i*3, b);
+}
+
+static void quantize(const GLfloat* xyz, size_t count, const float offset[3],
+                     const float scale[3], uint16_t* out)
+{
+    const __m128 off = _mm_setr_ps(offset[0], offset[1], offset[2], 0);
+    const __m128 sc = _mm_setr_ps(scale[0], scale[1], scale[2], 0);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 top = _mm_set1_ps(65535.0f);
+
+    // Clamp in float before converting, matching Scalar::quantize_one:
+    // _mm_max_ps returns its second operand for NaN, so NaN becomes 0, and
+    // values of 2^31 or more don't wrap through the integer conversion.
+
+    // SSE2 only has a signed 16-bit saturating pack, so shift the range
+    // down by 32768 before packing and flip the sign bit back afterwards.
+    const __m128i bias = _mm_set1_epi32(32768);
+    const __m128i flip = _mm_set1_epi16(short(0x8000));
+    const __m128i mask = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+
+    // Two vertices per iteration; the second load reads one float past
+    // the pair, so the last two vertices are left to the scalar code.
+    size_t i = 0;
+    for (; i + 2 < count; i += 2)
+    {
+        const __m128 a = _mm_loadu_ps(xyz + i*3);
+        const __m128 c = _mm_loadu_ps(xyz + i*3 + 3);
+        const __m128 fa = _mm_min_ps(_mm_max_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_sub_ps(a, off), sc), half), zero), top);
+        const __m128 fc = _mm_min_ps(_mm_max_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_sub_ps(c, off), sc), half), zero), top);
+        const __m128i qa = _mm_sub_epi32(_mm_cvttps_epi32(fa), bias);
+        const __m128i qc = _mm_sub_epi32(_mm_cvttps_epi32(fc), bias);
+        const __m128i q = _mm_xor_si128(_mm_packs_epi32(qa, qc), flip);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i*4),
+                         _mm_and_si128(q, mask));
+    }
+    Scalar::quantize(xyz + i*3, count - i, offset, scale, out + i*4);
+}
+
+}   // namespace SSE2
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef KERNELS_AVX2
+namespace AVX2
+{
+
+__attribute__((target("avx2")))
+static void bounds(const GLfloat* xyz, size_t count, Bounds& b)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+    __m256 lo[3], hi[3];
+    for (int k=0; k < 3; ++k)
+    {
+        lo[k] = _mm256_set1_ps(inf);
+        hi[k] = _mm256_set1_ps(-inf);
+    }
+
+    // Eight vertices fill three registers exactly
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        for (int k=0; k < 3; ++k)
+        {
+            const __m256 v = _mm256_loadu_ps(xyz + i*3 + k*8);
+            lo[k] = _mm256_min_ps(v, lo[k]);
+            hi[k] = _mm256_max_ps(v, hi[k]);
+        }
+    }
+
+    float l[24], h[24];
+    for (int k=0; k < 3; ++k)
+    {
+        _mm256_storeu_ps(l + k*8, lo[k]);
+        _mm256_storeu_ps(h + k*8, hi[k]);
+    }
+    reduce_interleaved(l, h, 24, b);
+    Scalar::bounds(xyz + i*3, count - i, b);
+}
+
+__attribute__((target("avx2")))
+static void deinterleave_stl(const uint8_t* r, size_t tri_count, Vertex* out)
+{
+    // The first two vertices come from one 32-byte load, spread out into
+    // two 16-byte vertices; the third is copied as in the SSE2 version.
+    const __m256i spread = _mm256_setr_epi32(0, 1, 2, 2, 3, 4, 5, 5);
+    size_t t = 0;
+    for (; t + 1 < tri_count; ++t)
+    {
+        const float* f = reinterpret_cast<const float*>(r + 12);
+        _mm256_storeu_ps(&out[0].x, _mm256_permutevar8x32_ps(
+                _mm256_loadu_ps(f), spread));
+        _mm_storeu_ps(&out[2].x, _mm_loadu_ps(f + 6));
+        r += 50;
+        out += 3;
+    }
+    Scalar::deinterleave_stl(r, tri_count - t, out);
+}
+
+__attribute__((target("avx2")))
+static void flatten(const Vertex* in, size_t count, GLfloat* xyz, Bounds& b)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+    __m256 lo = _mm256_set1_ps(inf);
+    __m256 hi = _mm256_set1_ps(-inf);
+
+    // Two vertices per iteration, packed into the low six lanes.  Each
+    // store writes two floats past the pair, which later vertices then
+    // overwrite, so the last vertices are left to the scalar code.
+    const __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    size_t i = 0;
+    for (; i + 2 < count; i += 2)
+    {
+        const __m256 v = _mm256_loadu_ps(&in[i].x);
+        _mm256_storeu_ps(xyz + i*3, _mm256_permutevar8x32_ps(v, pack));
+        lo = _mm256_min_ps(v, lo);
+        hi = _mm256_max_ps(v, hi);
+    }
+
+    float l[8], h[8];
+    _mm256_storeu_ps(l, lo);
+    _mm256_storeu_ps(h, hi);
+    reduce_interleaved(l, h, 3, b);
+    reduce_interleaved(l + 4, h + 4, 3, b);
+    Scalar::flatten(in + i, count - i, xyz + i*3, b);
+}
+
+}   // namespace AVX2
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct Table
+{
+    Isa isa;
+    void (*bounds)(const GLfloat*, size_t, Bounds&);
+    void (*deinterleave_stl)(const uint8_t*, size_t, Vertex*);
+    void (*flatten)(const Vertex*, size_t, GLfloat*, Bounds&);
+    void (*quantize)(const GLfloat*, size_t, const float*, const float*,
+                     uint16_t*);
+};
+
+static const Table scalar_table = {
+    Isa::Scalar, Scalar::bounds, Scalar::deinterleave_stl, Scalar::flatten,
+    Scalar::quantize};
+
+#ifdef KERNELS_SSE2
+static const Table sse2_table = {
+    Isa::SSE2, SSE2::bounds, SSE2::deinterleave_stl, SSE2::flatten,
+    SSE2::quantize};
+#endif
+
+#ifdef KERNELS_AVX2
+// Quantization gains nothing over SSE2 from the wider registers, since
+// it's limited by packing
+static const Table avx2_table = {
+    Isa::AVX2, AVX2::bounds, AVX2::deinterleave_stl, AVX2::flatten,
+    SSE2::quantize};
+#endif
+
+static const Table* table_for(Isa isa)
+{
+    switch (isa)
+    {
+        case Isa::AVX2:
+#ifdef KERNELS_AVX2
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+            {
+                return &avx2_table;
+            }
+#endif
+            return nullptr;
+        case Isa::SSE2:
+#ifdef KERNELS_SSE2
+            return &sse2_table;
+#else
+            return nullptr;
+#endif
+        case Isa::Scalar:
+            break;
+    }
+    return &scalar_table;
+}
+
+static std::atomic<const Table*> active(nullptr);
+
+static const Table& table()
+{
+    const Table* t = active.load(std::memory_order_acquire);
+    if (!t)
+    {
+        for (auto isa : {Isa::AVX2, Isa::SSE2, Isa::Scalar})
+        {
+            if ((t = table_for(isa)))
+            {
+                break;
+            }
+        }
+        active.store(t, std::memory_order_release);
+    }
+    return *t;
+}
+
+Isa isa()
+{
+    return table().isa;
+}
+
+const char* isa_name(Isa isa)
+{
+    switch (isa)
+    {
+        case Isa::AVX2: return "avx2";
+        case Isa::SSE2: return "sse2";
+        case Isa::Scalar: break;
+    }
+    return "scalar";
+}
+
+bool set_isa(Isa isa)
+{
+    const Table* t = table_for(isa);
+    if (t)
+    {
+        active.store(t, std::memory_order_release);
+    }
+    return t != nullptr;
+}
+
+void bounds(const GLfloat* xyz, size_t count, Bounds& b)
+{
+    table().bounds(xyz, count, b);
+}
+
+void deinterleave_stl(const uint8_t* records, size_t tri_count, Vertex* out)
+{
+    table().deinterleave_stl(records, tri_count, out);
+}
+
+void flatten(const Vertex* in, size_t count, GLfloat* xyz, Bounds& b)
+{
+    table().flatten(in, count, xyz, b);
+}
+
+void quantize(const GLfloat* xyz, size_t count, const float offset[3],
+              const float scale[3], uint16_t* out)
+{
+    table().quantize(xyz, count, offset, scale, out);
+}
+
+}   // namespace Kernels
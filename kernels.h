@@ -0,0 +1,46 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <QtOpenGL/QtOpenGL>
+
+#include <cstdint>
+
+#include "mesh.h"
+#include "vertex.h"
+
+/*
+ *  Per-vertex loops used by the loader and Mesh, with SSE2 and AVX2
+ *  versions where the CPU supports them.  The implementation is picked
+ *  at runtime, on first use.
+ */
+namespace Kernels
+{
+    enum class Isa { Scalar, SSE2, AVX2 };
+
+    /*  Returns the implementation in use */
+    Isa isa();
+    const char* isa_name(Isa isa);
+
+    /*  Switches to the given implementation (used by the benchmarks),
+     *  returning false if this CPU or build doesn't support it */
+    bool set_isa(Isa isa);
+
+    /*  Grows b to cover count xyz triples */
+    void bounds(const GLfloat* xyz, size_t count, Bounds& b);
+
+    /*  Copies the three vertices out of each 50-byte binary STL triangle
+     *  record.  The i field of the output vertices is left unspecified. */
+    void deinterleave_stl(const uint8_t* records, size_t tri_count,
+                          Vertex* out);
+
+    /*  Packs count vertices into xyz triples, growing b to cover them */
+    void flatten(const Vertex* in, size_t count, GLfloat* xyz, Bounds& b);
+
+    /*  Maps each xyz triple onto 16-bit integers, as
+     *  round((v - offset) * scale) clamped to [0, 65535], writing four
+     *  values per vertex (the fourth is zero) */
+    void quantize(const GLfloat* xyz, size_t count, const float offset[3],
+                  const float scale[3], uint16_t* out);
+}
+
+#endif // KERNELS_H
@@ -1,32 +1,107 @@
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QtEndian>
+
+#include <algorithm>
 #include <future>
 
+#include "bvh.h"
+#include "kernels.h"
 #include "loader.h"
+#include "meshcache.h"
+#include "meshfile.h"
+#include "simplify.h"
+#include "stlparser.h"
+#include "trace.h"
 #include "vertex.h"
 
-Loader::Loader(QObject* parent, const QString& filename, bool is_reload)
-    : QThread(parent), filename(filename), is_reload(is_reload)
+Loader::Loader(QObject* parent, const QString& filename, bool is_reload,
+               const QByteArray& cache_key)
+    : QThread(parent), filename(filename), is_reload(is_reload),
+      cache_key(cache_key)
 {
-    // Nothing to do here
+    qRegisterMetaType<LoadStats>();
+    qRegisterMetaType<MeshPtr>();
+    qRegisterMetaType<LodsPtr>();
+    qRegisterMetaType<BvhPtr>();
+
+    QSettings settings("ImplicitCAD", "ExplicitCAD");
+    dedup = dedup_method_from_name(
+                settings.value("loader/dedup", "radix").toString());
+    stream_previews = settings.value("loader/streaming", true).toBool();
+    lods = settings.value("loader/lod", true).toBool();
 }
 
 void Loader::run()
 {
-    Mesh* mesh = load_stl();
+    Trace::Span span("Loader::run");
+    QElapsedTimer timer;
+    timer.start();
+    const bool cached = filename.isEmpty();
+    Mesh* mesh = cached ? load_cached() : load_stl();
+    stats.parse_ms = timer.nsecsElapsed() / 1e6 - stats.sort_ms
+                   - stats.dedup_ms - stats.wait_ms;
     if (mesh)
     {
-        if (mesh->empty())
+        if (isInterruptionRequested())
+        {
+            delete mesh;
+        }
+        else if (mesh->empty())
         {
             emit error_empty_mesh();
             delete mesh;
         }
         else
         {
-            emit got_mesh(mesh, is_reload);
+            // The canvas shares the mesh, so it can be displayed while
+            // it's still being exported and written into the cache
+            const MeshPtr shared(mesh);
+            emit got_stats(stats);
+            emit got_mesh(shared, is_reload);
             emit loaded_file(filename);
+
+            // Levels of detail only matter once the camera moves, and the
+            // picking hierarchy once the cursor is over the mesh, so both
+            // can follow the mesh onto the screen
+            if (lods && !isInterruptionRequested())
+            {
+                Lods levels = build_lods(*shared);
+                if (!levels.empty())
+                {
+                    emit got_lods(
+                            std::make_shared<const Lods>(std::move(levels)));
+                }
+            }
+            if (picking && !isInterruptionRequested())
+            {
+                emit got_bvh(std::make_shared<const Bvh>(shared));
+            }
+            if (!export_path.isEmpty())
+            {
+                Trace::Span span("MeshFile::write");
+                if (!MeshFile::write(*shared, export_path, true))
+                {
+                    emit error_export_failed();
+                }
+            }
+            if (!cache_key.isEmpty() && !cached)
+            {
+                Trace::Span span("MeshCache::store");
+                MeshCache::instance().store(cache_key, *shared);
+            }
         }
     }
 }
 
+void Loader::send_preview(const Vertex* verts, size_t count)
+{
+    std::vector<GLfloat> flat_verts(count * 3);
+    Bounds bounds;
+    Kernels::flatten(verts, count, flat_verts.data(), bounds);
+    emit got_preview(new Mesh(std::move(flat_verts), {}, bounds), is_reload);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 void parallel_sort(Vertex* begin, Vertex* end, int threads)
@@ -61,14 +136,12 @@ Mesh* Loader::empty_mesh(){
     return new Mesh(std::move(verts), std::move(indices));
 }
 
-Mesh* mesh_from_verts(uint32_t tri_count, QVector<Vertex>& verts)
+Mesh* mesh_from_verts(uint32_t tri_count, std::vector<Vertex>& verts,
+                      DedupMethod method, LoadStats* stats)
 {
-    // Save indicies as the second element in the array
-    // (so that we can reconstruct triangle order after sorting)
-    for (size_t i=0; i < tri_count*3; ++i)
-    {
-        verts[i].i = i;
-    }
+    Trace::Span span("mesh_from_verts");
+    QElapsedTimer timer;
+    timer.start();
 
     // Check how many threads the hardware can safely support. This may return
     // 0 if the property can't be read so we shoud check for that too.
@@ -78,11 +151,49 @@ Mesh* mesh_from_verts(uint32_t tri_count, QVector<Vertex>& verts)
         threads = 8;
     }
 
+    if (method == DedupMethod::Hash)
+    {
+        std::vector<GLfloat> flat_verts;
+        std::vector<GLuint> indices;
+        Bounds bounds;
+        Trace::Span dedup_span("dedup");
+        hash_dedup(verts.data(), size_t(tri_count)*3, threads,
+                   flat_verts, indices, bounds);
+        if (stats)
+        {
+            stats->dedup_ms += timer.nsecsElapsed() / 1e6;
+        }
+        return new Mesh(std::move(flat_verts), std::move(indices), bounds);
+    }
+
+    // Save indicies as the second element in the array
+    // (so that we can reconstruct triangle order after sorting)
+    for (size_t i=0; i < size_t(tri_count)*3; ++i)
+    {
+        verts[i].i = i;
+    }
+
     // Sort the set of vertices (to deduplicate)
-    parallel_sort(verts.begin(), verts.end(), threads);
+    {
+        Trace::Span sort_span("sort");
+        if (method == DedupMethod::Radix)
+        {
+            radix_sort(verts.data(), verts.data() + verts.size(), threads);
+        }
+        else
+        {
+            parallel_sort(verts.data(), verts.data() + verts.size(), threads);
+        }
+    }
+    if (stats)
+    {
+        stats->sort_ms += timer.nsecsElapsed() / 1e6;
+    }
+    timer.restart();
+    Trace::Span dedup_span("dedup");
 
     // This vector will store triangles as sets of 3 indices
-    std::vector<GLuint> indices(tri_count*3);
+    std::vector<GLuint> indices(size_t(tri_count)*3);
 
     // Go through the sorted vertex list, deduplicating and creating
     // an indexed geometry representation for the triangles.
@@ -99,20 +210,37 @@ Mesh* mesh_from_verts(uint32_t tri_count, QVector<Vertex>& verts)
     }
     verts.resize(vertex_count);
 
-    std::vector<GLfloat> flat_verts;
-    flat_verts.reserve(vertex_count*3);
-    for (auto v : verts)
+    // Flatten the unique vertices, collecting the bounding box on the way
+    // so that nobody has to scan the vertex array for it again
+    std::vector<GLfloat> flat_verts(vertex_count*3);
+    Bounds bounds;
+    Kernels::flatten(verts.data(), vertex_count, flat_verts.data(),
+                     bounds);
+    if (stats)
     {
-        flat_verts.push_back(v.x);
-        flat_verts.push_back(v.y);
-        flat_verts.push_back(v.z);
+        stats->dedup_ms += timer.nsecsElapsed() / 1e6;
     }
 
-    return new Mesh(std::move(flat_verts), std::move(indices));
+    return new Mesh(std::move(flat_verts), std::move(indices), bounds);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
+Mesh* Loader::load_cached()
+{
+    Trace::Span span("MeshCache::load");
+    Mesh* mesh = MeshCache::instance().load(cache_key);
+    if (mesh)
+    {
+        stats.triangles = mesh->triangle_count();
+    }
+    else
+    {
+        emit cache_miss();
+    }
+    return mesh;
+}
+
 Mesh* Loader::load_stl()
 {
     QFile file(filename);
@@ -122,67 +250,140 @@ Mesh* Loader::load_stl()
         return NULL;
     }
 
-    // First, try to read the stl as an ASCII file
-    if (file.read(5) == "solid")
+    // Pipes and FIFOs can't be mapped or rewound, so they're parsed as
+    // the data arrives
+    if (file.isSequential())
     {
-        file.readLine(); // skip solid name
-        const auto line = file.readLine().trimmed();
-        if (line.startsWith("facet") ||
-            line.startsWith("endsolid"))
+        return read_stl_stream(file);
+    }
+
+    // Small files load quickly enough that a preview would only flicker,
+    // and on reload the previous mesh stays up until the new one is ready.
+    streaming = stream_previews && !is_reload &&
+                file.size() >= preview_min_bytes;
+
+    // Meshes in our own format are already indexed, so they skip parsing
+    // and deduplication entirely
+    if (MeshFile::detect(file))
+    {
+        Trace::Span span("MeshFile::read");
+        Mesh* mesh = MeshFile::read(file);
+        if (mesh)
+        {
+            stats.triangles = mesh->triangle_count();
+        }
+        else
         {
-            file.seek(0);
-            return read_stl_ascii(file);
+            emit error_bad_mesh_file();
         }
-        confusing_stl = true;
+        return mesh;
     }
-    else
+
+    // First, try to read the stl as an ASCII file
+    if (is_ascii_stl(file))
     {
-        confusing_stl = false;
+        return read_stl_ascii(file);
     }
 
-    // Otherwise, skip the rest of the header material and read as binary
-    file.seek(0);
+    // Otherwise, read it as binary (warning if its header could fool
+    // other programs into reading it as ASCII)
+    confusing_stl = file.peek(5) == "solid";
     return read_stl_binary(file);
 }
 
-Mesh* Loader::read_stl_binary(QFile& file)
+bool Loader::is_ascii_stl(QFile& file)
 {
-    QDataStream data(&file);
-    data.setByteOrder(QDataStream::LittleEndian);
-    data.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    bool ascii = false;
+    if (file.read(5) == "solid")
+    {
+        file.readLine(); // skip solid name
+        const auto line = file.readLine().trimmed();
+        ascii = line.startsWith("facet") || line.startsWith("endsolid");
+    }
+    file.seek(0);
+    return ascii;
+}
 
+Mesh* Loader::read_stl_binary(QFile& file)
+{
+    Trace::Span span("Loader::read_stl_binary");
     // Load the triangle count from the .stl file
     file.seek(80);
-    uint32_t tri_count;
-    data >> tri_count;
+    uchar header[4];
+    if (file.read(reinterpret_cast<char*>(header), 4) != 4)
+    {
+        emit error_bad_stl();
+        return NULL;
+    }
+    const uint32_t tri_count = qFromLittleEndian<quint32>(header);
 
-    // Verify that the file is the right size
-    if (file.size() != 84 + tri_count*50)
+    // Verify that the file is the right size (in 64 bits, since multi-GB
+    // files would overflow the 32-bit product)
+    const qint64 payload = qint64(tri_count) * 50;
+    if (file.size() != 84 + payload)
     {
         emit error_bad_stl();
         return NULL;
     }
+    if (qint64(tri_count) * 3 > max_vertices)
+    {
+        emit error_too_large();
+        return NULL;
+    }
 
     // Extract vertices into an array of xyz, unsigned pairs
-    QVector<Vertex> verts(tri_count*3);
-
-    // Dummy array, because readRawData is faster than skipRawData
-    std::unique_ptr<uint8_t> buffer(new uint8_t[tri_count * 50]);
-    data.readRawData((char*)buffer.get(), tri_count * 50);
+    std::vector<Vertex> verts(size_t(tri_count)*3);
+    stats.triangles = tri_count;
+    stats.peak_bytes = verts.size() * sizeof(Vertex);
 
-    // Store vertices in the array, processing one triangle at a time.
-    auto b = buffer.get() + 3 * sizeof(float);
-    for (auto v=verts.begin(); v != verts.end(); v += 3)
+    // Walk the triangle records in place through a read-only mapping, so
+    // the only full-size copy we make is the vertex array itself.
+    uchar* data = payload ? file.map(84, payload) : NULL;
+    if (data)
     {
-        // Load vertex data from .stl file into vertices
-        for (unsigned i=0; i < 3; ++i)
+        const size_t batch = streaming ? preview_batch : tri_count;
+        for (size_t t=0; t < tri_count && !isInterruptionRequested(); t += batch)
         {
-            memcpy(&v[i], b, 3*sizeof(float));
-            b += 3 * sizeof(float);
+            const size_t n = std::min<size_t>(batch, tri_count - t);
+            Kernels::deinterleave_stl(data + t*50, n, verts.data() + t*3);
+            if (streaming)
+            {
+                send_preview(verts.data() + t*3, n*3);
+            }
         }
+        file.unmap(data);
+    }
+    else if (payload)
+    {
+        // Mapping can fail (e.g. on some network filesystems), so fall
+        // back to reading through a fixed-size buffer.
+        const size_t chunk = 1 << 16;
+        std::vector<uchar> buffer(chunk * 50);
+        file.seek(84);
+        size_t sent = 0;
+        for (size_t t=0; t < tri_count && !isInterruptionRequested(); t += chunk)
+        {
+            const size_t n = std::min<size_t>(chunk, tri_count - t);
+            if (file.read(reinterpret_cast<char*>(buffer.data()), n * 50)
+                    != qint64(n * 50))
+            {
+                emit error_bad_stl();
+                return NULL;
+            }
+            Kernels::deinterleave_stl(buffer.data(), n, verts.data() + t*3);
+            if (streaming && (t + n - sent >= preview_batch ||
+                              t + n == tri_count))
+            {
+                send_preview(verts.data() + sent*3, (t + n - sent)*3);
+                sent = t + n;
+            }
+        }
+    }
 
-        // Skip face attribute and next face's normal vector
-        b += 3 * sizeof(float) + sizeof(uint16_t);
+    // A superseded load stops here, before the expensive deduplication
+    if (isInterruptionRequested())
+    {
+        return NULL;
     }
 
     if (confusing_stl)
@@ -190,60 +391,348 @@ Mesh* Loader::read_stl_binary(QFile& file)
         emit warning_confusing_stl();
     }
 
-    return mesh_from_verts(tri_count, verts);
+    return mesh_from_verts(tri_count, verts, dedup, &stats);
 }
 
 Mesh* Loader::read_stl_ascii(QFile& file)
 {
-    file.readLine();
-    uint32_t tri_count = 0;
-    QVector<Vertex> verts(tri_count*3);
+    Trace::Span span("Loader::read_stl_ascii");
+    // Parse straight out of a read-only mapping where possible
+    const qint64 size = file.size();
+    uchar* data = size ? file.map(0, size) : NULL;
+    QByteArray buffer;
+    if (!data)
+    {
+        buffer = file.readAll();
+    }
+    const char* begin = data ? reinterpret_cast<const char*>(data)
+                             : buffer.constData();
+    const char* end = begin + (data ? size : buffer.size());
 
+    // Skip the solid name
+    const char* body = StlParser::skip_line(begin, end);
+
+    // Split the body into roughly equal chunks of at least 1 MB, with every
+    // chunk boundary at the start of a facet
+    auto threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+    {
+        threads = 8;
+    }
+    const size_t chunks = std::max<size_t>(
+            1, std::min<size_t>(threads, (end - body) >> 20));
+    std::vector<const char*> bounds(chunks + 1, end);
+    bounds[0] = body;
+    for (size_t i=1; i < chunks; ++i)
+    {
+        const char* p = std::max(body + (end - body) * i / chunks,
+                                 bounds[i - 1]);
+        bounds[i] = StlParser::next_facet(p, begin, end);
+    }
+
+    // Estimate each chunk's triangle count from the length of the first
+    // facet (with a little slack for shorter numbers later on), so that
+    // the vertex array can be allocated once and parsed into directly.
+    const char* first = StlParser::next_facet(body, begin, end);
+    const char* second = StlParser::next_facet(
+            StlParser::skip_line(first, end), begin, end);
+    const size_t facet_bytes = (second > first) ? (second - first) : 256;
+    std::vector<size_t> offsets(chunks + 1);
+    for (size_t i=0; i < chunks; ++i)
+    {
+        const size_t tris = (bounds[i + 1] - bounds[i]) / facet_bytes;
+        offsets[i + 1] = offsets[i] + (tris + tris / 16 + 1) * 3;
+    }
+    if (offsets[chunks] > size_t(max_vertices))
+    {
+        emit error_too_large();
+        return NULL;
+    }
+    std::vector<Vertex> verts(offsets[chunks]);
+
+    std::vector<StlParser::Sink> sinks;
+    sinks.reserve(chunks);
+    for (size_t i=0; i < chunks; ++i)
+    {
+        sinks.emplace_back(verts.data() + offsets[i],
+                           verts.data() + offsets[i + 1]);
+    }
+    std::vector<StlParser::Result> results(chunks);
+    const auto parse = [&](size_t i) {
+        const char* p = bounds[i];
+        results[i] = StlParser::parse_facets(p, bounds[i + 1], sinks[i]);
+
+        // Each chunk is sent as its own preview batch as soon as it's done
+        if (streaming && results[i] != StlParser::Result::Bad)
+        {
+            const Vertex* start = verts.data() + offsets[i];
+            send_preview(start, sinks[i].out - start);
+            if (!sinks[i].overflow.empty())
+            {
+                send_preview(sinks[i].overflow.data(),
+                             sinks[i].overflow.size());
+            }
+        }
+    };
+    std::vector<std::future<void>> futures;
+    for (size_t i=1; i < chunks; ++i)
+    {
+        futures.push_back(std::async(std::launch::async, parse, i));
+    }
+    parse(0);
+    for (auto& f : futures)
+    {
+        f.wait();
+    }
+
+    if (data)
+    {
+        file.unmap(data);
+    }
+    if (isInterruptionRequested())
+    {
+        return NULL;
+    }
+
+    stats.peak_bytes = verts.size() * sizeof(Vertex);
+    for (const auto& sink : sinks)
+    {
+        stats.reallocations += sink.reallocations;
+        stats.peak_bytes += sink.overflow.capacity() * sizeof(Vertex);
+    }
+
+    // As with a line-by-line read, parsing stops at the first endsolid, and
+    // anything after it (including malformed text) is ignored.
     bool okay = true;
-    while (!file.atEnd() && okay)
+    size_t used = chunks;
+    for (size_t i=0; i < chunks; ++i)
     {
-        const auto line = file.readLine().simplified();
-        if (line.startsWith("endsolid"))
+        if (results[i] == StlParser::Result::Bad)
         {
+            okay = false;
             break;
         }
-        else if (!line.startsWith("facet normal") ||
-                 !file.readLine().simplified().startsWith("outer loop"))
+        else if (results[i] == StlParser::Result::EndSolid)
         {
-            okay = false;
+            used = i + 1;
             break;
         }
+    }
 
-        for (int i=0; i < 3; ++i)
+    if (okay)
+    {
+        // Close the gaps left by overestimated chunks, then append any
+        // triangles that spilled over from underestimated ones.
+        Vertex* v = verts.data();
+        for (size_t i=0; i < used; ++i)
         {
-            auto line = file.readLine().simplified().split(' ');
-            if (line[0] != "vertex")
+            v = std::copy(verts.data() + offsets[i], sinks[i].out, v);
+        }
+        size_t vert_count = v - verts.data();
+        for (size_t i=0; i < used; ++i)
+        {
+            const auto& overflow = sinks[i].overflow;
+            if (overflow.empty())
             {
-                okay = false;
-                break;
+                continue;
+            }
+            if (vert_count + overflow.size() > size_t(max_vertices))
+            {
+                emit error_too_large();
+                return NULL;
+            }
+            if (vert_count + overflow.size() > size_t(verts.size()))
+            {
+                verts.resize(vert_count + overflow.size());
+                stats.reallocations++;
             }
-            const float x = line[1].toFloat(&okay);
-            const float y = line[2].toFloat(&okay);
-            const float z = line[3].toFloat(&okay);
-            verts.push_back(Vertex(x, y, z));
+            std::copy(overflow.begin(), overflow.end(),
+                      verts.data() + vert_count);
+            vert_count += overflow.size();
         }
-        if (!file.readLine().trimmed().startsWith("endloop") ||
-            !file.readLine().trimmed().startsWith("endfacet"))
+        verts.resize(vert_count);
+        stats.triangles = vert_count / 3;
+        stats.peak_bytes = std::max<size_t>(stats.peak_bytes,
+                                            verts.size() * sizeof(Vertex));
+
+        return mesh_from_verts(vert_count / 3, verts, dedup, &stats);
+    }
+    else
+    {
+        emit error_bad_stl();
+        return NULL;
+    }
+}
+
+bool Loader::fill(QFile& file, QByteArray& buf, int size)
+{
+    while (buf.size() < size && !isInterruptionRequested())
+    {
+        // Reads block until the writer has produced something
+        QElapsedTimer timer;
+        timer.start();
+        const QByteArray more = file.read(std::max(size - buf.size(), 1 << 20));
+        stats.wait_ms += timer.nsecsElapsed() / 1e6;
+        if (more.isEmpty())
         {
-            okay = false;
-            break;
+            return false;
         }
-        tri_count++;
+        buf.append(more);
     }
+    return buf.size() >= size;
+}
 
-    if (okay)
+Mesh* Loader::read_stl_stream(QFile& file)
+{
+    Trace::Span span("Loader::read_stl_stream");
+    // Nothing is known about the size up front, so preview batches are
+    // sent whenever enough triangles have arrived (and the remainder is
+    // only sent if there were earlier batches, so small meshes don't
+    // flicker)
+    streaming = stream_previews && !is_reload;
+    confusing_stl = false;
+
+    // Tell ASCII and binary apart the same way as load_stl, but from the
+    // first chunk of data, since we can't seek back to the start
+    QByteArray buf;
+    fill(file, buf, 1 << 16);
+    bool ascii = false;
+    if (buf.startsWith("solid"))
     {
-        return mesh_from_verts(tri_count, verts);
+        const int eol = buf.indexOf('\n');
+        const QByteArray line = (eol < 0) ? QByteArray()
+            : buf.mid(eol + 1, buf.indexOf('\n', eol + 1) - eol - 1).trimmed();
+        ascii = line.startsWith("facet") || line.startsWith("endsolid");
+        confusing_stl = !ascii;
+    }
+
+    std::vector<Vertex> verts;
+    size_t count = 0;
+    size_t sent = 0;
+    const auto send_batches = [&](bool last) {
+        if (streaming && (count - sent >= preview_batch * 3 ||
+                          (last && sent && count > sent)))
+        {
+            send_preview(verts.data() + sent, count - sent);
+            sent = count;
+        }
+    };
+
+    if (ascii)
+    {
+        // Parse everything up to the last complete facet, keeping the
+        // partial facet at the end of the buffer for the next round
+        verts.resize(1 << 16);
+        int pos = StlParser::skip_line(buf.constData(),
+                                       buf.constData() + buf.size())
+                  - buf.constData();
+        bool eof = false;
+        auto result = StlParser::Result::Done;
+        while (result == StlParser::Result::Done && !isInterruptionRequested())
+        {
+            const char* start = buf.constData() + pos;
+            const char* stop = buf.constData() + buf.size();
+            if (!eof)
+            {
+                const int last = buf.lastIndexOf("endfacet");
+                stop = (last < pos) ? start
+                     : StlParser::skip_line(buf.constData() + last, stop);
+            }
+
+            StlParser::Sink sink(verts.data() + count,
+                                 verts.data() + verts.size());
+            result = StlParser::parse_facets(start, stop, sink);
+            count = sink.out - verts.data();
+            stats.reallocations += sink.reallocations;
+            if (!sink.overflow.empty())
+            {
+                const size_t needed = count + sink.overflow.size();
+                if (needed > size_t(max_vertices))
+                {
+                    emit error_too_large();
+                    return NULL;
+                }
+                qint64 size = verts.size();
+                while (size_t(size) < needed)
+                {
+                    size = std::min(size * 2, max_vertices);
+                }
+                verts.resize(size);
+                stats.reallocations++;
+                std::copy(sink.overflow.begin(), sink.overflow.end(),
+                          verts.data() + count);
+                count += sink.overflow.size();
+            }
+            send_batches(false);
+
+            if (eof)
+            {
+                break;
+            }
+            buf.remove(0, stop - buf.constData());
+            pos = 0;
+            eof = !fill(file, buf, buf.size() + 1);
+        }
+
+        // A stream cut short by an interruption is dropped below
+        if (result == StlParser::Result::Bad && !isInterruptionRequested())
+        {
+            emit error_bad_stl();
+            return NULL;
+        }
     }
     else
     {
-        emit error_bad_stl();
+        if (buf.size() < 84)
+        {
+            emit error_bad_stl();
+            return NULL;
+        }
+        const uint32_t tri_count = qFromLittleEndian<quint32>(
+                reinterpret_cast<const uchar*>(buf.constData() + 80));
+        buf.remove(0, 84);
+        if (qint64(tri_count) * 3 > max_vertices)
+        {
+            emit error_too_large();
+            return NULL;
+        }
+
+        // The count can't be checked against the file size, so grow the
+        // vertex array as records arrive rather than trusting it up front
+        const int chunk = (1 << 16) * 50;
+        for (size_t t=0; t < tri_count && !isInterruptionRequested();)
+        {
+            const bool more = fill(file, buf, chunk);
+            const size_t n = std::min<size_t>(buf.size() / 50, tri_count - t);
+            if (!more && t + n < tri_count && !isInterruptionRequested())
+            {
+                emit error_bad_stl();
+                return NULL;
+            }
+            verts.resize((t + n) * 3);
+            Kernels::deinterleave_stl(
+                    reinterpret_cast<const uint8_t*>(buf.constData()), n,
+                    verts.data() + t * 3);
+            buf.remove(0, n * 50);
+            t += n;
+            count = t * 3;
+            send_batches(false);
+        }
+    }
+
+    if (isInterruptionRequested())
+    {
         return NULL;
     }
-}
+    send_batches(true);
 
+    if (confusing_stl)
+    {
+        emit warning_confusing_stl();
+    }
+
+    verts.resize(count);
+    stats.triangles = count / 3;
+    stats.peak_bytes = verts.capacity() * sizeof(Vertex);
+    return mesh_from_verts(count / 3, verts, dedup, &stats);
+}
@@ -3,40 +3,157 @@
 
 #include <QThread>
 
+#include <limits>
+#include <vector>
+
+#include "bvh.h"
+#include "dedup.h"
 #include "mesh.h"
+#include "simplify.h"
+#include "vertex.h"
+
+/*
+ *  Statistics about how a mesh was loaded, reported alongside it
+ */
+struct LoadStats
+{
+    uint32_t triangles = 0;
+
+    /*  Number of times vertex storage had to grow while parsing */
+    size_t reallocations = 0;
+
+    /*  Peak bytes of vertex storage held while parsing */
+    size_t peak_bytes = 0;
+
+    /*  Time spent in each stage, in milliseconds.  Parsing covers reading
+     *  the file and anything else that isn't sorting or deduplication.
+     *  When a file is streamed in, time spent blocked waiting for its
+     *  writer (i.e. extopenscad) is counted separately as waiting. */
+    double parse_ms = 0;
+    double sort_ms = 0;
+    double dedup_ms = 0;
+    double wait_ms = 0;
+};
+Q_DECLARE_METATYPE(LoadStats)
+Q_DECLARE_METATYPE(MeshPtr)
+
+typedef std::shared_ptr<const Lods> LodsPtr;
+Q_DECLARE_METATYPE(LodsPtr)
+Q_DECLARE_METATYPE(BvhPtr)
 
 class Loader : public QThread
 {
     Q_OBJECT
 public:
-    explicit Loader(QObject* parent, const QString& filename, bool is_reload);
+    /*  If cache_key is given, the finished mesh is stored in MeshCache.
+     *  Without a filename, the mesh is read from MeshCache instead,
+     *  emitting cache_miss if it's no longer there. */
+    explicit Loader(QObject* parent, const QString& filename, bool is_reload,
+                    const QByteArray& cache_key=QByteArray());
+    /*  Loads the file, emitting got_mesh or one of the error signals.
+     *  If interruption is requested, the load stops early and nothing
+     *  more is emitted (other than finished). */
     void run();
+
+    /*  Also writes the finished mesh to the given file, in MeshFile format */
+    void set_export(const QString& path) { export_path = path; }
+    /*  Overrides the loader/lod setting */
+    void set_lods(bool enabled) { lods = enabled; }
+    /*  Skips building a Bvh, for meshes that will never be displayed */
+    void set_picking(bool enabled) { picking = enabled; }
     static Mesh* empty_mesh();
 
+    /*  Tells an ASCII STL from a binary one (whose header may also start
+     *  with "solid") by its first facet, then rewinds the file */
+    static bool is_ascii_stl(QFile& file);
+
+    /*  Every vertex read from a file becomes one entry in the mesh's index
+     *  buffer, whose length GL takes as a GLsizei */
+    static constexpr qint64 max_vertices =
+            std::numeric_limits<GLsizei>::max();
+
 protected:
     Mesh* load_stl();
+    Mesh* load_cached();
 
     /*  Reads an ASCII stl, starting from the start of the file*/
     Mesh* read_stl_ascii(QFile& file);
     /*  Reads a binary stl, assuming we're at the end of the header */
     Mesh* read_stl_binary(QFile& file);
+    /*  Reads an ASCII or binary stl from a pipe or FIFO, parsing it
+     *  incrementally while the writer is still producing it */
+    Mesh* read_stl_stream(QFile& file);
+    /*  Appends data from a sequential file to buf until it holds at least
+     *  size bytes, returning false if the file ends or interruption is
+     *  requested first */
+    bool fill(QFile& file, QByteArray& buf, int size);
+
+    /*  Emits a non-indexed copy of some vertices through got_preview */
+    void send_preview(const Vertex* verts, size_t count);
+
+    /*  Filled in by the read_stl_* functions */
+    LoadStats stats;
 
 signals:
     void loaded_file(QString filename);
-    void got_mesh(Mesh* m, bool is_reload);
+    void got_mesh(MeshPtr m, bool is_reload);
+    /*  Levels of detail for the mesh from got_mesh, which are built after
+     *  it has been handed off for display */
+    void got_lods(LodsPtr lods);
+    /*  Picking hierarchy for the mesh from got_mesh, built after the
+     *  levels of detail */
+    void got_bvh(BvhPtr bvh);
+
+    /*  While a large file is parsed, batches of raw triangles are emitted
+     *  (as meshes without indices) so that they can be shown right away */
+    void got_preview(Mesh* m, bool is_reload);
+    void got_stats(const LoadStats& stats);
 
     void error_bad_stl();
+    /*  A file in MeshFile format that couldn't be read */
+    void error_bad_mesh_file();
+    /*  The file holds more triangles than a mesh can index */
+    void error_too_large();
     void error_empty_mesh();
     void warning_confusing_stl();
     void error_missing_file();
+    void error_export_failed();
+    void cache_miss();
 
 private:
     const QString filename;
     bool is_reload;
+    const QByteArray cache_key;
+    QString export_path;
+
+    /*  Selected from the loader/dedup setting when the loader is created */
+    DedupMethod dedup;
+
+    /*  Whether to emit got_preview batches, and whether this file is
+     *  large enough for it to be worth doing */
+    bool stream_previews;
+
+    /*  Whether to build simplified levels of detail (loader/lod) and a
+     *  hierarchy for picking */
+    bool lods;
+    bool picking = true;
+    bool streaming = false;
+    static constexpr qint64 preview_min_bytes = 16 << 20;
+    static constexpr size_t preview_batch = 1 << 20;
 
     /*  Used to warn on binary STLs that begin with the word 'solid'" */
     bool confusing_stl;
 
 };
 
+/*  Sorts vertices, splitting the work across the given number of threads */
+void parallel_sort(Vertex* begin, Vertex* end, int threads);
+
+/*  Builds an indexed mesh from tri_count * 3 vertices, merging duplicates
+ *  with the given method.  verts is used as scratch space.  If stats is
+ *  given, the time taken to sort and deduplicate is added to it, so that
+ *  a loader's stats cover every call made while reading one file. */
+Mesh* mesh_from_verts(uint32_t tri_count, std::vector<Vertex>& verts,
+                      DedupMethod method, LoadStats* stats=nullptr);
+
 #endif // LOADER_H
@@ -21,14 +21,44 @@
 
 #include <QApplication>
 
+#include <cstring>
+
+#include "batch.h"
 #include "mainwindow.h"
+#include "trace.h"
 
 int main(int argc, char *argv[])
 {
     Q_INIT_RESOURCE(explicitcad);
 
+    // --trace <file> records from the start, and writes out the trace on
+    // exit (in either mode)
+    QString trace;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (!strcmp(argv[i], "--trace")) {
+            trace = QString::fromLocal8Bit(argv[i + 1]);
+            Trace::set_enabled(true);
+        }
+    }
+
+    // Batch mode may run without a display, so it has to be picked before
+    // a QApplication gets created
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--batch")) {
+            const int result = run_batch(argc, argv);
+            if (!trace.isEmpty() && !Trace::write(trace)) {
+                qWarning("Could not write %s", qPrintable(trace));
+            }
+            return result;
+        }
+    }
+
     QApplication app(argc, argv);
     MainWindow mainWin;
     mainWin.show();
-    return app.exec();
+    const int result = app.exec();
+    if (!trace.isEmpty() && !Trace::write(trace)) {
+        qWarning("Could not write %s", qPrintable(trace));
+    }
+    return result;
 }
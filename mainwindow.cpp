@@ -39,8 +39,10 @@
 #include <QToolBar>
 
 #include "mainwindow.h"
+#include "meshfile.h"
 #include "preferences.h"
 #include "tab.h"
+#include "trace.h"
 
 static QString filename(const QString &fullFileName)
 {
@@ -74,6 +76,12 @@ MainWindow::MainWindow()
             return;
         }
 
+        // Renders for the shown tab come first
+        scheduler.set_active(getTab(idx));
+        for (int i = 0; i < main->count(); ++i) {
+            getTab(i)->set_foreground(i == idx);
+        }
+
         Tab const *const tab = getTab(idx);
         setWindowTitle(tab);
         const bool available = tab->hasSelectedCode();
@@ -83,6 +91,15 @@ MainWindow::MainWindow()
     });
 }
 
+MainWindow::~MainWindow()
+{
+    // Tabs give up their render slots when they're destroyed, so they
+    // have to go before the scheduler does
+    while (main->count()) {
+        delete main->widget(0);
+    }
+}
+
 Tab *MainWindow::currentTab() const
 {
     return dynamic_cast<Tab *>(main->currentWidget());
@@ -136,9 +153,10 @@ bool MainWindow::closeTab(Tab *const tab)
 
 void MainWindow::newFile()
 {
-    Tab *tab = new Tab();
+    Tab *tab = new Tab(&scheduler);
     const int idx = main->addTab(tab, untitled);
     main->setCurrentIndex(idx);
+    scheduler.set_active(tab);
     tab->setFocus();
     setWindowTitle(tab);
 
@@ -146,6 +164,7 @@ void MainWindow::newFile()
         cutAct->setEnabled(available);
         copyAct->setEnabled(available);
     });
+    connect(preferences, &Preferences::changed, tab, &Tab::read_settings);
 }
 
 void MainWindow::open()
@@ -231,10 +250,15 @@ void MainWindow::documentWasModified()
 
 bool MainWindow::exportSTL()
 {
-    QString fileName = QFileDialog::getSaveFileName(this);
+    QString fileName = QFileDialog::getSaveFileName(
+        this, tr("Export"), QString(),
+        tr("STL files (*.stl);;ExplicitCAD meshes (*.%1)")
+            .arg(MeshFile::extension));
     if (fileName.isEmpty())
         return false;
-    currentTab()->render(fileName, 0.5);
+    QSettings settings("ImplicitCAD", "ExplicitCAD");
+    currentTab()->render(
+        fileName, settings.value("render/export_resolution", 0.5).toFloat());
     return true;
 }
 
@@ -314,6 +338,30 @@ void MainWindow::createActions()
     exportAct->setShortcut(tr("F6"));
     exportAct->setStatusTip(tr("Render the script to a high resolution STL and display it"));
     connect(exportAct, SIGNAL(triggered()),this,SLOT(exportSTL()));
+
+    cancelAct = new QAction(tr("Cancel Render"),this);
+    cancelAct->setShortcut(tr("Shift+F5"));
+    cancelAct->setStatusTip(tr("Stop the render that is currently running"));
+    connect(cancelAct, &QAction::triggered, [=] { currentTab()->cancel(); });
+
+    traceAct = new QAction(tr("Record Trace"), this);
+    traceAct->setCheckable(true);
+    traceAct->setChecked(Trace::enabled());
+    traceAct->setStatusTip(tr("Record how long each stage of rendering and "
+                              "loading takes"));
+    connect(traceAct, &QAction::toggled, &Trace::set_enabled);
+
+    saveTraceAct = new QAction(tr("Save Trace..."), this);
+    saveTraceAct->setStatusTip(tr("Save the recorded trace, for viewing in "
+                                  "Perfetto or chrome://tracing"));
+    connect(saveTraceAct, &QAction::triggered, [=] {
+        const QString fileName = QFileDialog::getSaveFileName(
+            this, tr("Save Trace"), QString(), tr("Trace files (*.json)"));
+        if (!fileName.isEmpty() && !Trace::write(fileName)) {
+            QMessageBox::warning(this, tr("Application"),
+                                 tr("Cannot write file %1.").arg(fileName));
+        }
+    });
 }
 
 void MainWindow::createMenus()
@@ -325,6 +373,7 @@ void MainWindow::createMenus()
     fileMenu->addAction(saveAsAct);
     fileMenu->addAction(renderAct);
     fileMenu->addAction(exportAct);
+    fileMenu->addAction(cancelAct);
     fileMenu->addSeparator();
     fileMenu->addAction(closeTabAct);
     fileMenu->addAction(exitAct);
@@ -342,6 +391,8 @@ void MainWindow::createMenus()
 
     helpMenu->addSeparator();
 
+    helpMenu->addAction(traceAct);
+    helpMenu->addAction(saveTraceAct);
     helpMenu->addAction(prefAct);
 }
 
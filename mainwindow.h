@@ -24,6 +24,8 @@
 
 #include <QMainWindow>
 
+#include "renderscheduler.h"
+
 class QAction;
 class QMenu;
 class QTabWidget;
@@ -36,6 +38,7 @@ class MainWindow : public QMainWindow
 
   public:
     MainWindow();
+    ~MainWindow();
 
   protected:
     void closeEvent(QCloseEvent *event);
@@ -65,6 +68,9 @@ class MainWindow : public QMainWindow
     void writeSettings();
     bool maybeSave(Tab *const);
 
+    /*  Shared by every tab, so it must outlive them */
+    RenderScheduler scheduler;
+
     QTabWidget *main;
 
     Preferences *preferences;
@@ -88,6 +94,9 @@ class MainWindow : public QMainWindow
     QAction *aboutQtAct;
     QAction *renderAct;
     QAction *exportAct;
+    QAction *cancelAct;
+    QAction *traceAct;
+    QAction *saveTraceAct;
 };
 
 #endif
@@ -4,12 +4,20 @@
 
 #include <cmath>
 
+#include "kernels.h"
 #include "mesh.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
 Mesh::Mesh(std::vector<GLfloat>&& v, std::vector<GLuint>&& i)
     : vertices(std::move(v)), indices(std::move(i))
+{
+    Kernels::bounds(vertices.data(), vertices.size() / 3, bounds);
+}
+
+Mesh::Mesh(std::vector<GLfloat>&& v, std::vector<GLuint>&& i,
+           const Bounds& b)
+    : vertices(std::move(v)), indices(std::move(i)), bounds(b)
 {
     // Nothing to do here
 }
@@ -20,12 +28,7 @@ float Mesh::min(size_t start) const
     {
         return -1;
     }
-    float v = vertices[start];
-    for (size_t i=start; i < vertices.size(); i += 3)
-    {
-        v = fmin(v, vertices[i]);
-    }
-    return v;
+    return bounds.lower[start];
 }
 
 float Mesh::max(size_t start) const
@@ -34,12 +37,7 @@ float Mesh::max(size_t start) const
     {
         return 1;
     }
-    float v = vertices[start];
-    for (size_t i=start; i < vertices.size(); i += 3)
-    {
-        v = fmax(v, vertices[i]);
-    }
-    return v;
+    return bounds.upper[start];
 }
 
 bool Mesh::empty() const
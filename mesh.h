@@ -4,13 +4,51 @@
 #include <QString>
 #include <QtOpenGL/QtOpenGL>
 
+#include <cmath>
+#include <limits>
+#include <memory>
 #include <vector>
 
+/*
+ *  Axis-aligned bounding box, accumulated one point at a time
+ */
+struct Bounds
+{
+    float lower[3] = {std::numeric_limits<float>::infinity(),
+                      std::numeric_limits<float>::infinity(),
+                      std::numeric_limits<float>::infinity()};
+    float upper[3] = {-std::numeric_limits<float>::infinity(),
+                      -std::numeric_limits<float>::infinity(),
+                      -std::numeric_limits<float>::infinity()};
+
+    void add(const GLfloat* p)
+    {
+        for (int i=0; i < 3; ++i)
+        {
+            lower[i] = fmin(lower[i], p[i]);
+            upper[i] = fmax(upper[i], p[i]);
+        }
+    }
+    void add(const Bounds& b)
+    {
+        for (int i=0; i < 3; ++i)
+        {
+            lower[i] = fmin(lower[i], b.lower[i]);
+            upper[i] = fmax(upper[i], b.upper[i]);
+        }
+    }
+};
+
 class Mesh
 {
 public:
+    /*  Computes the bounding box with one pass over the vertices */
     Mesh(std::vector<GLfloat>&& vertices, std::vector<GLuint>&& indices);
 
+    /*  Uses a bounding box that the caller has already computed */
+    Mesh(std::vector<GLfloat>&& vertices, std::vector<GLuint>&& indices,
+         const Bounds& bounds);
+
     float min(size_t start) const;
     float max(size_t start) const;
 
@@ -23,11 +61,23 @@ public:
 
     bool empty() const;
 
+    size_t vertex_count() const { return vertices.size() / 3; }
+    size_t triangle_count() const { return indices.size() / 3; }
+
+    const std::vector<GLfloat>& vertex_data() const { return vertices; }
+    const std::vector<GLuint>& index_data() const { return indices; }
+    const Bounds& bbox() const { return bounds; }
+
 private:
     std::vector<GLfloat> vertices;
     std::vector<GLuint> indices;
+    Bounds bounds;
 
     friend class GLMesh;
 };
 
+/*  Meshes are shared between the loader, which may still be writing one
+ *  out, and the canvas that displays it */
+typedef std::shared_ptr<const Mesh> MeshPtr;
+
 #endif // MESH_H
@@ -0,0 +1,177 @@
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSettings>
+#include <QStandardPaths>
+
+#include "mesh.h"
+#include "meshcache.h"
+#include "meshfile.h"
+
+/*  Hashed into every key, so that bumping it makes old entries miss.
+ *  Version 2 moved entries from a cache-specific header to MeshFile. */
+static const uint32_t cache_version = 2;
+
+MeshCache& MeshCache::instance()
+{
+    static MeshCache cache;
+    return cache;
+}
+
+MeshCache::MeshCache()
+    : dir(QStandardPaths::writableLocation(
+              QStandardPaths::GenericCacheLocation) + "/explicitcad/meshes")
+{
+    QDir().mkpath(dir);
+
+    // Pick up entries from earlier sessions, using their modification
+    // time as the last time they were used
+    QDirIterator it(dir, {"*.mesh"}, QDir::Files);
+    while (it.hasNext())
+    {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        entries[info.baseName().toLatin1()] = {info.size(), info.lastModified()};
+        total_bytes += info.size();
+    }
+}
+
+qint64 MeshCache::max_bytes()
+{
+    QSettings settings("ImplicitCAD", "ExplicitCAD");
+    return settings.value("cache/size_mb", 512).toLongLong() << 20;
+}
+
+bool MeshCache::enabled() const
+{
+    return max_bytes() > 0;
+}
+
+QByteArray MeshCache::key(const QString& script, float resolution)
+{
+    // extopenscad doesn't report a version, so identify the binary by its
+    // path, size and modification time instead
+    static const QByteArray renderer = [] {
+        const QFileInfo info(QStandardPaths::findExecutable("extopenscad"));
+        return (info.absoluteFilePath() + ":" +
+                QString::number(info.size()) + ":" +
+                QString::number(info.lastModified().toMSecsSinceEpoch()))
+            .toUtf8();
+    }();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray::number(cache_version));
+    hash.addData(renderer);
+    hash.addData(QByteArray::number(resolution, 'g', 9));
+    hash.addData(script.toUtf8());
+    return hash.result().toHex();
+}
+
+QString MeshCache::path(const QByteArray& key) const
+{
+    return dir + "/" + QString::fromLatin1(key) + ".mesh";
+}
+
+bool MeshCache::contains(const QByteArray& key)
+{
+    QMutexLocker lock(&mutex);
+    return enabled() && entries.contains(key);
+}
+
+Mesh* MeshCache::load(const QByteArray& key)
+{
+    QMutexLocker lock(&mutex);
+
+    auto entry = entries.find(key);
+    if (entry == entries.end() || !enabled())
+    {
+        miss_count++;
+        return NULL;
+    }
+
+    // Anything unreadable is dropped, so that the next render replaces it
+    QFile file(path(key));
+    Mesh* mesh = file.open(QIODevice::ReadOnly) ? MeshFile::read(file) : NULL;
+    file.close();
+    if (!mesh)
+    {
+        QFile::remove(path(key));
+        total_bytes -= entry->size;
+        entries.erase(entry);
+        miss_count++;
+        return NULL;
+    }
+
+    entry->used = QDateTime::currentDateTime();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    if (file.open(QIODevice::ReadWrite))
+    {
+        file.setFileTime(entry->used, QFileDevice::FileModificationTime);
+    }
+#endif
+    hit_count++;
+    return mesh;
+}
+
+void MeshCache::store(const QByteArray& key, const Mesh& mesh)
+{
+    if (!enabled())
+    {
+        return;
+    }
+
+    // Skip meshes that could never fit (assuming they'd be stored as-is)
+    const qint64 estimate = (mesh.vertex_data().size() * sizeof(GLfloat) +
+                             mesh.index_data().size() * sizeof(GLuint));
+    if (estimate > max_bytes())
+    {
+        return;
+    }
+
+    // Write outside of the lock; the file is renamed into place once it's
+    // complete, so readers never see a partial entry.  Entries are left
+    // uncompressed, since they're read far more often than written.
+    if (!MeshFile::write(mesh, path(key), false))
+    {
+        return;
+    }
+    const qint64 size = QFileInfo(path(key)).size();
+
+    QMutexLocker lock(&mutex);
+    auto entry = entries.find(key);
+    if (entry != entries.end())
+    {
+        total_bytes -= entry->size;
+    }
+    entries[key] = {size, QDateTime::currentDateTime()};
+    total_bytes += size;
+    evict(key);
+}
+
+void MeshCache::evict(const QByteArray& keep)
+{
+    const qint64 cap = max_bytes();
+    while (total_bytes > cap)
+    {
+        auto oldest = entries.end();
+        for (auto it=entries.begin(); it != entries.end(); ++it)
+        {
+            if (it.key() != keep &&
+                (oldest == entries.end() || it->used < oldest->used))
+            {
+                oldest = it;
+            }
+        }
+        if (oldest == entries.end())
+        {
+            break;
+        }
+
+        QFile::remove(path(oldest.key()));
+        total_bytes -= oldest->size;
+        entries.erase(oldest);
+    }
+}
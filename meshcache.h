@@ -0,0 +1,69 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+
+class Mesh;
+
+/*
+ *  An on-disk cache of deduplicated meshes, keyed by everything that goes
+ *  into a render: the script text, the resolution and the extopenscad
+ *  binary.  Entries are evicted least-recently-used first once the total
+ *  size passes the cache/size_mb setting (a size of zero disables it).
+ *
+ *  The cache is shared by every tab and may be written from loader
+ *  threads, so all access goes through a mutex.
+ */
+class MeshCache
+{
+public:
+    static MeshCache& instance();
+
+    /*  Returns the key for rendering the given script */
+    static QByteArray key(const QString& script, float resolution);
+
+    /*  Checks for an entry, without counting a hit or miss */
+    bool contains(const QByteArray& key);
+
+    /*  Returns the cached mesh, or NULL (counting a miss) */
+    Mesh* load(const QByteArray& key);
+
+    /*  Writes a mesh into the cache, evicting old entries to make room */
+    void store(const QByteArray& key, const Mesh& mesh);
+
+    bool enabled() const;
+    quint64 hits() const { return hit_count; }
+    quint64 misses() const { return miss_count; }
+
+private:
+    MeshCache();
+
+    QString path(const QByteArray& key) const;
+
+    /*  Returns the cap from the cache/size_mb setting */
+    static qint64 max_bytes();
+
+    /*  Removes the least recently used entries until the cache fits in
+     *  max_bytes, skipping the given key.  The mutex must be held. */
+    void evict(const QByteArray& keep);
+
+    struct Entry
+    {
+        qint64 size;
+        QDateTime used;
+    };
+
+    QMutex mutex;
+    const QString dir;
+    QMap<QByteArray, Entry> entries;
+    qint64 total_bytes = 0;
+
+    quint64 hit_count = 0;
+    quint64 miss_count = 0;
+};
+
+#endif // MESHCACHE_H
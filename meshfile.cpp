@@ -0,0 +1,206 @@
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include "mesh.h"
+#include "meshfile.h"
+
+const char* const MeshFile::extension = "ecmesh";
+
+static const char magic[8] = {'E', 'C', 'A', 'D', 'M', 'E', 'S', 'H'};
+static const uint32_t version = 1;
+static const uint32_t flag_compressed = 1;
+
+/*  On-disk header, stored little-endian */
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    float lower[3];
+    float upper[3];
+    uint64_t payload_bytes;
+};
+static_assert(sizeof(Header) == 56, "Header must have no padding");
+
+/*  Converts an array of 32-bit words between little-endian and the host
+ *  order, which is a no-op everywhere we currently build */
+static void swap_words(void* data, size_t count)
+{
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    uint32_t* words = static_cast<uint32_t*>(data);
+    for (size_t i=0; i < count; ++i)
+    {
+        words[i] = qbswap(words[i]);
+    }
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(count);
+#endif
+}
+
+/*  The header is nothing but 32 and 64-bit fields after the magic */
+static void swap_header(Header& h)
+{
+    swap_words(&h.version, 10);
+    h.payload_bytes = qFromLittleEndian(h.payload_bytes);
+}
+
+bool MeshFile::detect(QFile& file)
+{
+    return file.peek(sizeof(magic)) == QByteArray(magic, sizeof(magic));
+}
+
+Mesh* MeshFile::read(QFile& file)
+{
+    // Map the whole file if we can, otherwise fall back to reading it
+    qint64 size = file.size();
+    QByteArray contents;
+    const uchar* data = file.map(0, size);
+    if (!data)
+    {
+        file.seek(0);
+        contents = file.readAll();
+        data = reinterpret_cast<const uchar*>(contents.constData());
+        size = contents.size();
+    }
+
+    Header header;
+    if (size < qint64(sizeof(header)))
+    {
+        return NULL;
+    }
+    memcpy(&header, data, sizeof(header));
+    swap_header(header);
+
+    const uint64_t vbytes = uint64_t(header.vertex_count) * 3 * sizeof(GLfloat);
+    const uint64_t ibytes = uint64_t(header.index_count) * sizeof(GLuint);
+    const uchar* payload = data + sizeof(header);
+    if (memcmp(header.magic, magic, sizeof(magic)) ||
+        header.version != version ||
+        header.index_count % 3 ||
+        header.payload_bytes != uint64_t(size) - sizeof(header))
+    {
+        return NULL;
+    }
+
+    QByteArray uncompressed;
+    if (header.flags & flag_compressed)
+    {
+        if (header.payload_bytes > INT_MAX)
+        {
+            return NULL;
+        }
+        uncompressed = qUncompress(payload, header.payload_bytes);
+        payload = reinterpret_cast<const uchar*>(uncompressed.constData());
+        if (uint64_t(uncompressed.size()) != vbytes + ibytes)
+        {
+            return NULL;
+        }
+    }
+    else if (header.payload_bytes != vbytes + ibytes)
+    {
+        return NULL;
+    }
+
+    std::vector<GLfloat> vertices(size_t(header.vertex_count) * 3);
+    std::vector<GLuint> indices(header.index_count);
+    memcpy(vertices.data(), payload, vbytes);
+    memcpy(indices.data(), payload + vbytes, ibytes);
+    swap_words(vertices.data(), vertices.size());
+    swap_words(indices.data(), indices.size());
+
+    // Out-of-range indices would make the GPU read past the vertex buffer
+    if (!indices.empty() &&
+        *std::max_element(indices.begin(), indices.end()) >= header.vertex_count)
+    {
+        return NULL;
+    }
+
+    Bounds bounds;
+    std::copy(header.lower, header.lower + 3, bounds.lower);
+    std::copy(header.upper, header.upper + 3, bounds.upper);
+    return new Mesh(std::move(vertices), std::move(indices), bounds);
+}
+
+bool MeshFile::write(const Mesh& mesh, const QString& filename, bool compress)
+{
+    const auto& vertices = mesh.vertex_data();
+    const auto& indices = mesh.index_data();
+    const qint64 vbytes = vertices.size() * sizeof(GLfloat);
+    const qint64 ibytes = indices.size() * sizeof(GLuint);
+
+    // qCompress works on a single QByteArray, so it can't take payloads
+    // of 2 GB or more
+    compress = compress && vbytes + ibytes < INT_MAX;
+
+    Header header;
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.flags = compress ? flag_compressed : 0;
+    header.vertex_count = mesh.vertex_count();
+    header.index_count = indices.size();
+    std::copy(mesh.bbox().lower, mesh.bbox().lower + 3, header.lower);
+    std::copy(mesh.bbox().upper, mesh.bbox().upper + 3, header.upper);
+
+    QByteArray compressed;
+    if (compress)
+    {
+        QByteArray payload(vbytes + ibytes, Qt::Uninitialized);
+        memcpy(payload.data(), vertices.data(), vbytes);
+        memcpy(payload.data() + vbytes, indices.data(), ibytes);
+        swap_words(payload.data(), payload.size() / 4);
+        compressed = qCompress(payload);
+        header.payload_bytes = compressed.size();
+    }
+    else
+    {
+        header.payload_bytes = vbytes + ibytes;
+    }
+    swap_header(header);
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly) ||
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header))
+            != sizeof(header))
+    {
+        return false;
+    }
+
+    if (compress)
+    {
+        if (file.write(compressed) != compressed.size())
+        {
+            return false;
+        }
+    }
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    else
+    {
+        std::vector<GLfloat> v(vertices);
+        std::vector<GLuint> i(indices);
+        swap_words(v.data(), v.size());
+        swap_words(i.data(), i.size());
+        if (file.write(reinterpret_cast<const char*>(v.data()), vbytes) != vbytes ||
+            file.write(reinterpret_cast<const char*>(i.data()), ibytes) != ibytes)
+        {
+            return false;
+        }
+    }
+#else
+    else if (file.write(reinterpret_cast<const char*>(vertices.data()), vbytes)
+                 != vbytes ||
+             file.write(reinterpret_cast<const char*>(indices.data()), ibytes)
+                 != ibytes)
+    {
+        return false;
+    }
+#endif
+
+    return file.commit();
+}
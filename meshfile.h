@@ -0,0 +1,36 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <QFile>
+#include <QString>
+
+class Mesh;
+
+/*
+ *  ExplicitCAD's own mesh format, which stores an already-deduplicated
+ *  mesh so that it can be loaded without parsing or merging vertices.
+ *
+ *  The file is a fixed-size header (magic, version, flags, vertex and
+ *  index counts, bounding box and payload size) followed by the payload:
+ *  xyz float triples, then 32-bit triangle indices, all little-endian.
+ *  If the compressed flag is set, the payload is run through qCompress.
+ */
+namespace MeshFile
+{
+    /*  File extension used when exporting, without the dot */
+    extern const char* const extension;
+
+    /*  Checks whether the file starts with the mesh file magic, without
+     *  moving the read position */
+    bool detect(QFile& file);
+
+    /*  Reads a mesh, mapping the file when possible.  Returns NULL if the
+     *  file is truncated or malformed. */
+    Mesh* read(QFile& file);
+
+    /*  Writes a mesh, replacing the target atomically.  Compression is
+     *  slower to write and read, but roughly halves the file size. */
+    bool write(const Mesh& mesh, const QString& filename, bool compress);
+}
+
+#endif // MESHFILE_H
@@ -1,8 +1,13 @@
 #include "preferences.h"
 
 #include <QCheckBox>
+#include <QComboBox>
 #include <QDialogButtonBox>
+#include <QDoubleSpinBox>
+#include <QFormLayout>
 #include <QSettings>
+#include <QSpinBox>
+#include <QThread>
 #include <QVBoxLayout>
 
 Preferences::Preferences(QWidget *parent, Qt::WindowFlags f)
@@ -13,15 +18,98 @@ Preferences::Preferences(QWidget *parent, Qt::WindowFlags f)
     autoRender = new QCheckBox("Render preview when saving file");
     autoRender->setChecked(autoRenderSetting);
 
+    streaming = new QCheckBox("Show large meshes progressively while loading");
+    streaming->setChecked(settings.value("loader/streaming", true).toBool());
+
+    lods = new QCheckBox("Draw large meshes simplified while moving the camera");
+    lods->setChecked(settings.value("loader/lod", true).toBool());
+
+    dedup = new QComboBox();
+    dedup->addItem("Radix sort", "radix");
+    dedup->addItem("Merge sort", "sort");
+    dedup->addItem("Hash table", "hash");
+    dedup->setCurrentIndex(
+        dedup->findData(settings.value("loader/dedup", "radix").toString()));
+
+    livePreview = new QCheckBox("Render preview while typing");
+    livePreview->setChecked(settings.value("live/enabled", false).toBool());
+
+    liveDelay = new QSpinBox();
+    liveDelay->setRange(0, 60000);
+    liveDelay->setSingleStep(50);
+    liveDelay->setSuffix(" ms");
+    liveDelay->setValue(settings.value("live/delay_ms", 750).toInt());
+
+    liveResolution = new QDoubleSpinBox();
+    liveResolution->setRange(0, 100);
+    liveResolution->setSingleStep(0.5);
+    liveResolution->setSpecialValueText("Default");
+    liveResolution->setValue(settings.value("live/resolution", 2.0).toDouble());
+
+    progressive = new QCheckBox("Refine previews progressively");
+    progressive->setChecked(settings.value("render/progressive", true).toBool());
+
+    const auto resolutionBox = [&](const QString& key, double value) {
+        auto box = new QDoubleSpinBox();
+        box->setRange(0, 100);
+        box->setSingleStep(0.5);
+        box->setSpecialValueText("Default");
+        box->setValue(settings.value(key, value).toDouble());
+        return box;
+    };
+    coarseResolution = resolutionBox("render/coarse_resolution", 4.0);
+    previewResolution = resolutionBox("render/preview_resolution", 0.0);
+    exportResolution = resolutionBox("render/export_resolution", 0.5);
+
+    maxJobs = new QSpinBox();
+    maxJobs->setRange(1, 256);
+    maxJobs->setValue(settings.value("render/max_jobs",
+                                     QThread::idealThreadCount()).toInt());
+
+    cacheSize = new QSpinBox();
+    cacheSize->setRange(0, 1 << 20);
+    cacheSize->setSuffix(" MB");
+    cacheSize->setSpecialValueText("Disabled");
+    cacheSize->setValue(settings.value("cache/size_mb", 512).toInt());
+
     buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok);
     connect(buttonBox, &QDialogButtonBox::accepted, [=] {
         QSettings settings("ImplicitCAD", "ExplicitCAD");
         settings.setValue("autorender", autoRender->isChecked());
+        settings.setValue("loader/streaming", streaming->isChecked());
+        settings.setValue("loader/lod", lods->isChecked());
+        settings.setValue("loader/dedup", dedup->currentData().toString());
+        settings.setValue("cache/size_mb", cacheSize->value());
+        settings.setValue("render/max_jobs", maxJobs->value());
+        settings.setValue("render/progressive", progressive->isChecked());
+        settings.setValue("render/coarse_resolution", coarseResolution->value());
+        settings.setValue("render/preview_resolution", previewResolution->value());
+        settings.setValue("render/export_resolution", exportResolution->value());
+        settings.setValue("live/enabled", livePreview->isChecked());
+        settings.setValue("live/delay_ms", liveDelay->value());
+        settings.setValue("live/resolution", liveResolution->value());
+        emit changed();
     });
     connect(buttonBox, SIGNAL(accepted()), this, SLOT(accept()));
 
     auto mainLayout = new QVBoxLayout(this);
     mainLayout->addWidget(autoRender);
+    mainLayout->addWidget(streaming);
+    mainLayout->addWidget(lods);
+    mainLayout->addWidget(livePreview);
+    mainLayout->addWidget(progressive);
+
+    auto form = new QFormLayout();
+    form->addRow("Vertex deduplication", dedup);
+    form->addRow("Concurrent renders", maxJobs);
+    form->addRow("Mesh cache size", cacheSize);
+    form->addRow("Coarse preview resolution", coarseResolution);
+    form->addRow("Preview resolution", previewResolution);
+    form->addRow("Export resolution", exportResolution);
+    form->addRow("Live preview delay", liveDelay);
+    form->addRow("Live preview resolution", liveResolution);
+    mainLayout->addLayout(form);
+
     mainLayout->addWidget(buttonBox);
 
     setLayout(mainLayout);
@@ -3,7 +3,10 @@
 #include <QDialog>
 
 class QCheckBox;
+class QComboBox;
 class QDialogButtonBox;
+class QDoubleSpinBox;
+class QSpinBox;
 
 class Preferences : public QDialog
 {
@@ -14,8 +17,24 @@ public:
 
 //public slots:
 
+signals:
+    /*  Emitted once the new settings have been saved */
+    void changed();
+
 private:
     QCheckBox *autoRender;
+    QCheckBox *streaming;
+    QCheckBox *lods;
+    QComboBox *dedup;
+    QSpinBox *maxJobs;
+    QSpinBox *cacheSize;
+    QCheckBox *livePreview;
+    QSpinBox *liveDelay;
+    QDoubleSpinBox *liveResolution;
+    QCheckBox *progressive;
+    QDoubleSpinBox *coarseResolution;
+    QDoubleSpinBox *previewResolution;
+    QDoubleSpinBox *exportResolution;
     QDialogButtonBox *buttonBox;
 };
 
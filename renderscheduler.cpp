@@ -0,0 +1,107 @@
+#include <QSettings>
+#include <QThread>
+
+#include <algorithm>
+
+#include "renderscheduler.h"
+
+QStringList extopenscad_args(const QString& input, const QString& output,
+                             float resolution, const QString& format)
+{
+    QStringList args{input, "-f", format, "-o", output};
+    if (resolution > 0)
+    {
+        args << "-r" << QString::number(resolution);
+    }
+    return args;
+}
+
+int RenderScheduler::max_jobs() const
+{
+    if (limit_override > 0)
+    {
+        return limit_override;
+    }
+    QSettings settings("ImplicitCAD", "ExplicitCAD");
+    return std::max(1, settings.value("render/max_jobs",
+                                      QThread::idealThreadCount()).toInt());
+}
+
+void RenderScheduler::request(QObject* owner,
+                              std::function<void(bool background)> start)
+{
+    release(owner);
+    queue.append({owner, start});
+    dispatch();
+}
+
+void RenderScheduler::release(QObject* owner)
+{
+    for (int i=0; i < queue.size(); ++i)
+    {
+        if (queue[i].owner == owner)
+        {
+            queue.removeAt(i);
+            break;
+        }
+    }
+    if (active.remove(owner))
+    {
+        dispatch();
+    }
+}
+
+void RenderScheduler::set_active(QObject* owner)
+{
+    active_owner = owner;
+    dispatch();
+}
+
+bool RenderScheduler::is_queued(QObject* owner) const
+{
+    for (const auto& r : queue)
+    {
+        if (r.owner == owner)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void RenderScheduler::dispatch()
+{
+    const int limit = max_jobs();
+    while (!queue.isEmpty())
+    {
+        // Serve the active owner first, then everyone else in order
+        int next = 0;
+        for (int i=0; i < queue.size(); ++i)
+        {
+            if (queue[i].owner == active_owner)
+            {
+                next = i;
+                break;
+            }
+        }
+        const bool background = queue[next].owner != active_owner;
+
+        // Background jobs keep a slot free for the active owner (unless
+        // there's only one).  If the best candidate can't start, nothing
+        // behind it can either.
+        const int busy = active.size();
+        const int background_busy = busy - active.contains(active_owner);
+        if (busy >= limit ||
+            (background && limit > 1 && background_busy >= limit - 1))
+        {
+            break;
+        }
+
+        // Take the request off the queue before starting it, since start
+        // may release its slot again straight away (e.g. if the process
+        // fails to launch)
+        const Request r = queue.takeAt(next);
+        active.insert(r.owner);
+        r.start(background);
+    }
+}
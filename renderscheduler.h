@@ -0,0 +1,65 @@
+#ifndef RENDERSCHEDULER_H
+#define RENDERSCHEDULER_H
+
+#include <QList>
+#include <QSet>
+#include <QStringList>
+
+#include <functional>
+
+class QObject;
+
+/*
+ *  Limits how many extopenscad processes run at once across all tabs.
+ *  Each owner (usually a Tab) asks for a slot and is called back once
+ *  one is free.  The limit comes from the render/max_jobs setting, which
+ *  defaults to the number of cores.
+ *
+ *  One owner at a time is active (the tab being shown).  Its requests
+ *  jump the queue, and when there's more than one slot, background
+ *  owners leave one free for it, so that they never hold it up.
+ */
+class RenderScheduler
+{
+public:
+    /*  Calls start as soon as there's a free slot, which may be before
+     *  this returns.  start is told whether the job is running for a
+     *  background owner.  An owner has at most one request; a new one
+     *  replaces whatever it had queued or running. */
+    void request(QObject* owner, std::function<void(bool background)> start);
+
+    /*  Gives up the owner's slot, or drops its queued request */
+    void release(QObject* owner);
+
+    void set_active(QObject* owner);
+    bool is_active(QObject* owner) const { return owner == active_owner; }
+
+    bool is_queued(QObject* owner) const;
+    int running() const { return active.size(); }
+    int queued() const { return queue.size(); }
+
+    /*  Returns the slot limit: the override if one was set, otherwise
+     *  the render/max_jobs setting */
+    int max_jobs() const;
+    void set_max_jobs(int jobs) { limit_override = jobs; }
+
+private:
+    void dispatch();
+
+    struct Request
+    {
+        QObject* owner;
+        std::function<void(bool)> start;
+    };
+    QList<Request> queue;
+    QSet<QObject*> active;
+    QObject* active_owner = nullptr;
+    int limit_override = 0;
+};
+
+/*  Builds the extopenscad command line for rendering input into output.
+ *  A resolution of zero leaves the choice to extopenscad. */
+QStringList extopenscad_args(const QString& input, const QString& output,
+                             float resolution, const QString& format="stl");
+
+#endif // RENDERSCHEDULER_H
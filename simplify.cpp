@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#include "mesh.h"
+#include "simplify.h"
+#include "trace.h"
+
+std::vector<GLuint> cluster_vertices(const Mesh& mesh, unsigned cells)
+{
+    const Bounds& box = mesh.bbox();
+    float longest = 0;
+    for (int i=0; i < 3; ++i)
+    {
+        longest = std::max(longest, box.upper[i] - box.lower[i]);
+    }
+    if (!(longest > 0))
+    {
+        return mesh.index_data();
+    }
+    const float cell = longest / cells;
+
+    uint64_t dims[3];
+    for (int i=0; i < 3; ++i)
+    {
+        dims[i] = uint64_t((box.upper[i] - box.lower[i]) / cell) + 1;
+    }
+
+    // Pick a representative for every occupied cell, and point each
+    // vertex at the representative of its cell
+    const auto& vertices = mesh.vertex_data();
+    const size_t vertex_count = mesh.vertex_count();
+    std::vector<GLuint> rep(vertex_count);
+    std::unordered_map<uint64_t, GLuint> first;
+    first.reserve(std::min<size_t>(vertex_count, size_t(cells) * cells * 8));
+    for (size_t v=0; v < vertex_count; ++v)
+    {
+        uint64_t key = 0;
+        for (int i=0; i < 3; ++i)
+        {
+            const uint64_t c = std::min<uint64_t>(
+                    dims[i] - 1, (vertices[v*3 + i] - box.lower[i]) / cell);
+            key = key * dims[i] + c;
+        }
+        rep[v] = first.emplace(key, v).first->second;
+    }
+
+    std::vector<GLuint> out;
+    const auto& indices = mesh.index_data();
+    for (size_t t=0; t < indices.size(); t += 3)
+    {
+        const GLuint a = rep[indices[t]];
+        const GLuint b = rep[indices[t + 1]];
+        const GLuint c = rep[indices[t + 2]];
+        if (a != b && b != c && a != c)
+        {
+            out.insert(out.end(), {a, b, c});
+        }
+    }
+    return out;
+}
+
+Lods build_lods(const Mesh& mesh)
+{
+    Lods lods;
+    if (mesh.triangle_count() <= size_t(lod_budget))
+    {
+        return lods;
+    }
+    Trace::Span span("build_lods");
+
+    // Each level aims for a quarter of the triangles of the one before.
+    // On a surface, the triangle count goes roughly with the square of
+    // the grid resolution, so each grid is sized from the previous run.
+    // A level is only kept if it at least halves the triangle count,
+    // otherwise it wouldn't draw noticeably faster than the one before.
+    size_t previous = mesh.index_data().size();
+    unsigned cells = 256;
+    size_t trial = cluster_vertices(mesh, cells).size();
+    for (int level=0; level < 2 && trial; ++level)
+    {
+        const double target = previous / 4.0;
+        cells = std::max(8u, unsigned(cells * std::sqrt(target / trial)));
+        auto lod = cluster_vertices(mesh, cells);
+        if (lod.empty() || lod.size() * 2 > previous)
+        {
+            break;
+        }
+        previous = trial = lod.size();
+        lods.push_back(std::move(lod));
+    }
+    return lods;
+}
@@ -0,0 +1,33 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <QtOpenGL/QtOpenGL>
+
+#include <vector>
+
+class Mesh;
+
+/*
+ *  Simplifies a mesh by vertex clustering: the bounding box is cut into a
+ *  grid with cells cells along its longest side, every vertex is snapped
+ *  to the first vertex found in its cell, and triangles that collapse
+ *  onto fewer than three cells are dropped.
+ *
+ *  The result indexes into the mesh's own vertices, so a level of detail
+ *  built this way can share the full mesh's vertex buffer.
+ */
+std::vector<GLuint> cluster_vertices(const Mesh& mesh, unsigned cells);
+
+/*  Simplified index lists over a mesh's vertices, from finest to coarsest,
+ *  for drawing while the camera is moving */
+typedef std::vector<std::vector<GLuint>> Lods;
+
+/*  While the camera is moving, the canvas draws the finest level of detail
+ *  with at most this many triangles */
+constexpr GLsizei lod_budget = 500000;
+
+/*  Builds progressively coarser levels of detail for meshes over the
+ *  budget, returning none for meshes that would never be drawn with them */
+Lods build_lods(const Mesh& mesh);
+
+#endif // SIMPLIFY_H
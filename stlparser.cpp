@@ -0,0 +1,199 @@
+#include <QByteArray>
+
+#include <algorithm>
+#include <cstring>
+
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+
+#include "stlparser.h"
+
+namespace StlParser
+{
+
+/*  Whitespace within a line (newlines are handled separately) */
+static inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+const char* skip_line(const char* p, const char* end)
+{
+    const void* eol = memchr(p, '\n', end - p);
+    return eol ? static_cast<const char*>(eol) + 1 : end;
+}
+
+/*  Finds the next non-blank line at or after p, returning its first
+ *  non-whitespace character (or end) and setting eol to its end */
+static const char* next_line(const char* p, const char* end, const char** eol)
+{
+    while (p != end && (is_space(*p) || *p == '\n'))
+    {
+        ++p;
+    }
+    const void* nl = memchr(p, '\n', end - p);
+    *eol = nl ? static_cast<const char*>(nl) : end;
+    return p;
+}
+
+/*  Checks whether [p, eol) starts with the given words, advancing p past
+ *  them if it does.  A space in words matches any run of whitespace. */
+static bool match(const char*& p, const char* eol, const char* words)
+{
+    const char* q = p;
+    for (; *words; ++words)
+    {
+        if (*words == ' ')
+        {
+            if (q == eol || !is_space(*q))
+            {
+                return false;
+            }
+            while (q != eol && is_space(*q))
+            {
+                ++q;
+            }
+        }
+        else if (q == eol || *q++ != *words)
+        {
+            return false;
+        }
+    }
+    p = q;
+    return true;
+}
+
+/*  Parses one whitespace-delimited float from [p, eol) */
+static bool parse_float(const char*& p, const char* eol, float* f)
+{
+    while (p != eol && is_space(*p))
+    {
+        ++p;
+    }
+    const char* start = p;
+    while (p != eol && !is_space(*p))
+    {
+        ++p;
+    }
+    if (start != p && *start == '+')
+    {
+        ++start;
+    }
+    if (start == p)
+    {
+        return false;
+    }
+
+#if defined(__cpp_lib_to_chars)
+    const auto r = std::from_chars(start, p, *f);
+    return r.ec == std::errc() && r.ptr == p;
+#else
+    // Standard libraries without floating-point from_chars: copy the token
+    // onto the stack, since QByteArray::toFloat needs it null-terminated.
+    char buf[64];
+    const size_t n = p - start;
+    if (n >= sizeof(buf))
+    {
+        return false;
+    }
+    memcpy(buf, start, n);
+    buf[n] = 0;
+    bool okay;
+    *f = QByteArray::fromRawData(buf, n).toFloat(&okay);
+    return okay;
+#endif
+}
+
+void Sink::push(const Vertex (&tri)[3])
+{
+    if (out_end - out >= 3)
+    {
+        std::copy(tri, tri + 3, out);
+        out += 3;
+    }
+    else
+    {
+        if (overflow.capacity() - overflow.size() < 3)
+        {
+            reallocations++;
+        }
+        overflow.insert(overflow.end(), tri, tri + 3);
+    }
+}
+
+Result parse_facets(const char*& begin, const char* end, Sink& sink)
+{
+    const char* eol;
+    const char* p = next_line(begin, end, &eol);
+    for (; p != end; p = next_line(eol, end, &eol))
+    {
+        if (match(p, eol, "endsolid"))
+        {
+            begin = eol;
+            return Result::EndSolid;
+        }
+        else if (!match(p, eol, "facet normal"))
+        {
+            return Result::Bad;
+        }
+
+        p = next_line(eol, end, &eol);
+        if (!match(p, eol, "outer loop"))
+        {
+            return Result::Bad;
+        }
+
+        Vertex tri[3];
+        for (auto& v : tri)
+        {
+            p = next_line(eol, end, &eol);
+            if (!match(p, eol, "vertex ") ||
+                !parse_float(p, eol, &v.x) ||
+                !parse_float(p, eol, &v.y) ||
+                !parse_float(p, eol, &v.z))
+            {
+                return Result::Bad;
+            }
+        }
+
+        p = next_line(eol, end, &eol);
+        if (!match(p, eol, "endloop"))
+        {
+            return Result::Bad;
+        }
+        p = next_line(eol, end, &eol);
+        if (!match(p, eol, "endfacet"))
+        {
+            return Result::Bad;
+        }
+        sink.push(tri);
+    }
+    begin = end;
+    return Result::Done;
+}
+
+const char* next_facet(const char* p, const char* line_begin,
+                       const char* end)
+{
+    if (p != line_begin && p[-1] != '\n')
+    {
+        p = skip_line(p, end);
+    }
+    for (; p != end; p = skip_line(p, end))
+    {
+        const char* q = p;
+        while (q != end && is_space(*q))
+        {
+            ++q;
+        }
+        const char* eol = static_cast<const char*>(memchr(q, '\n', end - q));
+        if (match(q, eol ? eol : end, "facet"))
+        {
+            return p;
+        }
+    }
+    return end;
+}
+
+}   // namespace StlParser
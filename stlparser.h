@@ -0,0 +1,46 @@
+#ifndef STLPARSER_H
+#define STLPARSER_H
+
+#include <vector>
+
+#include "vertex.h"
+
+/*
+ *  Non-allocating parser for the facets of an ASCII STL file, used by the
+ *  loader to parse chunks of a mapped file in parallel.
+ */
+namespace StlParser
+{
+    enum class Result { Done, EndSolid, Bad };
+
+    /*  Destination for parsed triangles: a preallocated slice of the
+     *  vertex array, which spills into a growable overflow vector if the
+     *  slice turns out to be too small */
+    struct Sink
+    {
+        Vertex* out;
+        Vertex* out_end;
+        std::vector<Vertex> overflow;
+        size_t reallocations = 0;
+
+        Sink(Vertex* out, Vertex* out_end) : out(out), out_end(out_end) {}
+        void push(const Vertex (&tri)[3]);
+    };
+
+    /*  Parses facets from [begin, end), pushing one triangle per facet.
+     *  Returns EndSolid if an endsolid line was reached (with begin updated
+     *  to point past it), Done if the range ended cleanly between facets,
+     *  or Bad if the text is malformed. */
+    Result parse_facets(const char*& begin, const char* end, Sink& sink);
+
+    /*  Returns the start of the first line at or after p which begins a
+     *  facet, or end if there is none.  line_begin is the start of the
+     *  buffer, used to tell whether p is already at the start of a line. */
+    const char* next_facet(const char* p, const char* line_begin,
+                           const char* end);
+
+    /*  Returns a pointer just past the end of the line containing p */
+    const char* skip_line(const char* p, const char* end);
+}
+
+#endif // STLPARSER_H
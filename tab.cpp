@@ -1,5 +1,6 @@
 #include <QApplication>
 #include <QDir>
+#include <QFileInfo>
 #include <QMessageBox>
 #include <QSettings>
 #include <QSplitter>
@@ -12,12 +13,23 @@
 
 #include <cmath>
 
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "loader.h"
+#include "meshcache.h"
+#include "meshfile.h"
+#include "renderscheduler.h"
 #include "tab.h"
+#include "trace.h"
 #include "canvas.h"
 
-Tab::Tab(QWidget *parent)
-    : QWidget(parent), code(new QsciScintilla()), lexer(new QsciLexerCPP()),
+Tab::Tab(RenderScheduler *scheduler, QWidget *parent)
+    : QWidget(parent), scheduler(scheduler), code(new QsciScintilla()), lexer(new QsciLexerCPP()),
       canvas(new Canvas(
           [] {
               QSurfaceFormat format;
@@ -71,6 +83,17 @@ Tab::Tab(QWidget *parent)
     toolbar->addAction(
         tr("Right"), [=] { canvas->setCameraAngle(Canvas::Direction::Right); });
 
+    // The performance overlay is remembered between sessions, so that it
+    // can be left on while tracking down a slow setup
+    auto hud = toolbar->addAction(tr("Stats"));
+    hud->setCheckable(true);
+    connect(hud, &QAction::toggled, [=](bool checked) {
+        QSettings("ImplicitCAD", "ExplicitCAD").setValue("view/hud", checked);
+        canvas->set_hud(checked);
+    });
+    hud->setChecked(
+        QSettings("ImplicitCAD", "ExplicitCAD").value("view/hud", false).toBool());
+
     auto preview_and_controls = new QWidget();
     auto preview_layout = new QVBoxLayout();
     preview_layout->setContentsMargins(0, 0, 0, 0);
@@ -94,28 +117,65 @@ Tab::Tab(QWidget *parent)
     layout->addWidget(h_splitter);
     setLayout(layout);
 
-    process.setProgram("extopenscad");
+    // Live preview: wait for typing to pause, then render at a coarse
+    // resolution.  Edits that come in while a live render is running are
+    // coalesced into a single pending render.
+    live_timer.setSingleShot(true);
+    read_settings();
+    connect(code, &QsciScintilla::textChanged, [=] {
+        if (live_enabled) {
+            live_timer.start(live_delay_ms);
+        }
 
-    connect(&process,
-            QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-            [=](int exitCode, QProcess::ExitStatus exitStatus) {
-                log(process.readAllStandardOutput());
-                logError(process.readAllStandardError());
-                if (exitStatus == QProcess::NormalExit && exitCode == 0) {
-                    load_stl(stl.fileName(), reload);
-                    reload = true;
-                    log("Rendering done.");
-                } else {
-                    logError("Rendering failed.");
-                }
-                canvas->set_status("");
-            });
+        // Refining a script that has since changed is wasted work
+        if (refining) {
+            refining = false;
+            abort_job(tr("Refinement stopped by an edit"));
+        }
+    });
+    connect(&live_timer, &QTimer::timeout, [=] {
+        if (job_running) {
+            live_pending = true;
+        } else {
+            live_preview();
+        }
+    });
 
     setFocusPolicy(Qt::StrongFocus);
     setFocusProxy(code);
     code->setFocus();
 }
 
+Tab::~Tab()
+{
+    // Renders may still be running, or winding down after being killed.
+    // Their handlers mustn't run on a half-destroyed tab.
+    for (QProcess *p : findChildren<QProcess *>()) {
+        p->disconnect(this);
+        p->kill();
+        p->waitForFinished();
+    }
+    scheduler->release(this);
+
+    // Loader threads (including superseded ones) may still be waiting
+    // for output, and must finish before they're destroyed with this tab
+    const auto loaders = findChildren<Loader *>();
+    for (Loader *l : loaders) {
+        l->requestInterruption();
+    }
+    close_fifo();
+    for (Loader *l : loaders) {
+        l->wait();
+    }
+}
+
+void Tab::read_settings()
+{
+    QSettings settings("ImplicitCAD", "ExplicitCAD");
+    live_enabled = settings.value("live/enabled", false).toBool();
+    live_delay_ms = settings.value("live/delay_ms", 750).toInt();
+}
+
 void Tab::log(const QString &str) const { console->append(str); }
 
 void Tab::logError(const QString &str) const
@@ -158,26 +218,280 @@ std::pair<bool, QString> Tab::writeFile(const QString &fileName) const
     return std::make_pair(true, "");
 }
 
-void Tab::call_implicitcad(const QString &inputFile, const QString outputFile,
-                           const float resolution, const QString &format)
+void Tab::start_job()
+{
+    job++;
+    job_running = true;
+    job_timer.start();
+    trace_job_start = Trace::now();
+}
+
+void Tab::finish_job()
+{
+    job_running = false;
+    if (Trace::enabled()) {
+        Trace::record_async("render job", trace_job_start, Trace::now(),
+                            this, job);
+    }
+
+    if (live_pending) {
+        live_pending = false;
+        live_preview();
+    } else if (refining && pass_loaded) {
+        refine();
+    } else {
+        refining = false;
+    }
+}
+
+void Tab::refine()
+{
+    if (pass_res == target_res) {
+        refining = false;
+        log(tr("Refinement done."));
+        return;
+    }
+
+    // Halve the resolution on each pass, finishing exactly on the target
+    // (which may be zero, i.e. whatever extopenscad picks by default)
+    const float next =
+        (target_res > 0 && pass_res / 2 > target_res) ? pass_res / 2
+                                                      : target_res;
+    start_preview(next);
+}
+
+void Tab::live_preview()
 {
-    if (process.state() == QProcess::ProcessState::Running) {
-        log("Renderer already running.");
+    QSettings settings("ImplicitCAD", "ExplicitCAD");
+    preview(settings.value("live/resolution", 2.0).toFloat());
+}
+
+void Tab::abort_job(const QString &reason)
+{
+    if (!job_running) {
         return;
     }
 
-    auto args = QStringList{inputFile, "-f", format, "-o", outputFile};
+    // Bumping the job number drops anything the old job still delivers.
+    // That includes its process, which only cleans up after itself once
+    // the kill has gone through.
+    job++;
+    if (process) {
+        process->kill();
+        process = nullptr;
+    }
+    scheduler->release(this);
+    if (loader) {
+        loader->requestInterruption();
+    }
+    close_fifo();
+    canvas->clear_preview();
+    canvas->set_status("");
+
+    if (Trace::enabled()) {
+        Trace::record_async("render job (cancelled)", trace_job_start,
+                            Trace::now(), this, job - 1);
+    }
+    const qint64 ms = job_timer.elapsed();
+    wasted_ms += ms;
+    job_running = false;
+    log(tr("%1 after %2 s (%3 s spent on cancelled renders so far).")
+            .arg(reason)
+            .arg(ms / 1000.0, 0, 'f', 1)
+            .arg(wasted_ms / 1000.0, 0, 'f', 1));
+}
+
+void Tab::cancel() { abort_job(tr("Render cancelled")); }
+
+void Tab::set_foreground(const bool foreground)
+{
+    if (process) {
+        renice(!foreground);
+    }
+}
+
+void Tab::renice(const bool background)
+{
+#ifdef Q_OS_UNIX
+    // Raising the priority again may not be allowed for unprivileged
+    // users, in which case the process just stays where it is.  A pid of
+    // zero would mean this process, so never pass one.
+    const qint64 pid = process ? process->processId() : 0;
+    if (pid > 0) {
+        setpriority(PRIO_PROCESS, pid, background ? 10 : 0);
+    }
+#else
+    Q_UNUSED(background);
+#endif
+}
+
+bool Tab::open_fifo(const QString &path)
+{
+#ifdef Q_OS_UNIX
+    // Every job gets a new FIFO, since a superseded loader may still have
+    // the old one open, and would read the next render's output from it
+    const QByteArray name = QFile::encodeName(path);
+    if (mkfifo(name.constData(), 0600)) {
+        return false;
+    }
+
+    // Hold a write end open for the whole job, so that the loader's open
+    // doesn't block on extopenscad, and so that the loader only sees the
+    // end of the file once we close it (even if extopenscad never opens
+    // the FIFO at all).  Opening for writing without blocking needs a
+    // reader, so briefly open one of our own.
+    const int reader = ::open(name.constData(), O_RDONLY | O_NONBLOCK);
+    fifo_writer = ::open(name.constData(), O_WRONLY | O_NONBLOCK);
+    if (reader >= 0) {
+        ::close(reader);
+    }
+    if (fifo_writer < 0) {
+        QFile::remove(path);
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(path);
+    return false;
+#endif
+}
 
-    if (resolution > 0) {
-        args.append("-r");
-        args.append(QString::number(resolution));
+void Tab::close_fifo()
+{
+#ifdef Q_OS_UNIX
+    if (fifo_writer >= 0) {
+        ::close(fifo_writer);
+        fifo_writer = -1;
     }
+#endif
+}
 
+QString Tab::scratch_file(const QString &suffix)
+{
+    return scratch.filePath(
+        QString("output-%1.%2").arg(++scratch_files).arg(suffix));
+}
+
+void Tab::remove_scratch(const QString &path)
+{
+    if (path.startsWith(scratch.path() + "/")) {
+        QFile::remove(path);
+    }
+}
+
+void Tab::connect_process(QProcess *p, const quint64 render_job,
+                          const QString &output)
+{
+    connect(p, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, [=](int exitCode, QProcess::ExitStatus exitStatus) {
+                p->deleteLater();
+
+                // abort_job has already reported on killed processes, but
+                // their partial output is only safe to remove now
+                if (render_job != job) {
+                    remove_scratch(output);
+                    return;
+                }
+                process = nullptr;
+                if (Trace::enabled()) {
+                    Trace::record_async("extopenscad", trace_render_start,
+                                        Trace::now(), this, render_job);
+                }
+                scheduler->release(this);
+                log(p->readAllStandardOutput());
+                logError(p->readAllStandardError());
+                const bool ok =
+                    exitStatus == QProcess::NormalExit && exitCode == 0;
+
+                // A streaming loader has been reading all along, and sees
+                // the end of the file once we close our end of the FIFO.
+                // If the render failed, stop it first so that it doesn't
+                // report on the partial output.
+                if (!ok && streaming_job && loader) {
+                    loader->requestInterruption();
+                }
+                close_fifo();
+
+                if (ok) {
+                    if (!streaming_job) {
+                        load_stl(output, reload, cache_key, export_path);
+                    }
+                    reload = true;
+                    canvas->set_render_time(job_timer.elapsed() -
+                                            queue_wait_ms);
+                    log(tr("Rendering done (%1 s waiting for a renderer, "
+                           "%2 s rendering).")
+                            .arg(queue_wait_ms / 1000.0, 0, 'f', 1)
+                            .arg((job_timer.elapsed() - queue_wait_ms) / 1000.0,
+                                 0, 'f', 1));
+                } else {
+                    logError("Rendering failed.");
+                }
+                canvas->set_status("");
+                if (!ok && !streaming_job) {
+                    remove_scratch(output);
+                    finish_job();
+                }
+            });
+    connect(p, &QProcess::errorOccurred, this,
+            [=](QProcess::ProcessError error) {
+                if (error != QProcess::FailedToStart) {
+                    return;
+                }
+                p->deleteLater();
+                if (render_job != job) {
+                    return;
+                }
+                process = nullptr;
+                logError(tr("Could not start extopenscad."));
+                scheduler->release(this);
+                if (streaming_job && loader) {
+                    loader->requestInterruption();
+                }
+                close_fifo();
+                canvas->set_status("");
+                if (!streaming_job) {
+                    finish_job();
+                }
+            });
+}
+
+void Tab::call_implicitcad(const QString &inputFile, const QString outputFile,
+                           const float resolution, const QString &format)
+{
+    // A new render replaces whatever is still running
+    abort_job(tr("Superseded the previous render"));
+    start_job();
+
+    const auto args =
+        extopenscad_args(inputFile, outputFile, resolution, format);
     qDebug() << args;
 
-    process.setArguments(args);
-    process.start();
-    process.waitForStarted();
+    // Wait for a free slot if other tabs are already rendering
+    const quint64 render_job = job;
+    scheduler->request(this, [=](bool background) {
+        queue_wait_ms = job_timer.elapsed();
+        trace_render_start = Trace::now();
+        if (Trace::enabled()) {
+            Trace::record_async("waiting for a renderer", trace_job_start,
+                                trace_render_start, this, render_job);
+        }
+
+        // Every job gets its own process, so that a superseded one can be
+        // killed without waiting for it to exit
+        process = new QProcess(this);
+        process->setProgram("extopenscad");
+        process->setArguments(args);
+        connect_process(process, render_job, outputFile);
+        process->start();
+        if (process && process->waitForStarted()) {
+            renice(background);
+        }
+    });
+    if (scheduler->is_queued(this)) {
+        log(tr("Waiting for %1 other render(s) to finish.")
+                .arg(scheduler->running()));
+    }
 }
 
 static const QString err_bad_stl{
@@ -185,6 +499,15 @@ static const QString err_bad_stl{
     "This <code>.stl</code> file is invalid or corrupted.<br>"
     "Please export it from the original source, verify, and retry."};
 
+static const QString err_bad_mesh_file{
+    "<b>Error:</b><br>"
+    "This <code>.ecmesh</code> file is invalid or corrupted.<br>"
+    "Please export it again and retry."};
+
+static const QString err_too_large{
+    "<b>Error:</b><br>"
+    "This <code>.stl</code> file has more triangles than can be loaded."};
+
 static const QString err_empty_mesh{
     "<b>Error:</b><br>"
     "This file is syntactically correct<br>but contains no triangles."};
@@ -199,26 +522,109 @@ static const QString warn_confusing_stl{
     "<code>fstl</code> loaded it, but other programs may be confused by this "
     "file."};
 
-void Tab::load_stl(const QString &fileName, const bool reload)
+void Tab::load_stl(const QString &fileName, const bool reload,
+                   const QByteArray &cache_key, const QString &export_path)
 {
     //canvas->set_status("Loading " + filename);
 
-    Loader* loader = new Loader(this, fileName, reload);
+    loader = new Loader(this, fileName, reload, cache_key);
+    loader->set_export(export_path);
 
-    connect(loader, &Loader::got_mesh,
-            canvas, &Canvas::load_mesh);
+    // Meshes from a job that has since been cancelled are thrown away
+    const quint64 loader_job = job;
+    const bool exact = final_job;
+    connect(
+        loader, &Loader::got_mesh, this,
+        [=](MeshPtr m, bool is_reload) {
+            if (loader_job == job) {
+                canvas->load_mesh(m, is_reload, exact);
+                pass_loaded = true;
+                if (fileName.isEmpty()) {
+                    log(tr("Loaded from cache (%1 hits, %2 misses).")
+                            .arg(MeshCache::instance().hits())
+                            .arg(MeshCache::instance().misses()));
+                }
+            }
+        },
+        Qt::QueuedConnection);
+    connect(
+        loader, &Loader::got_lods, this,
+        [=](LodsPtr lods) {
+            if (loader_job == job) {
+                canvas->load_lods(lods);
+            }
+        },
+        Qt::QueuedConnection);
+    connect(
+        loader, &Loader::got_bvh, this,
+        [=](BvhPtr bvh) {
+            if (loader_job == job) {
+                canvas->load_bvh(bvh);
+            }
+        },
+        Qt::QueuedConnection);
+    connect(
+        loader, &Loader::cache_miss, this,
+        [=] {
+            // The entry was evicted or unreadable, so render it after all
+            if (loader_job == job) {
+                job_running = false;
+                render_preview(pass_res);
+            }
+        },
+        Qt::QueuedConnection);
+    connect(
+        loader, &Loader::got_preview, this,
+        [=](Mesh *m, bool is_reload) {
+            if (loader_job == job) {
+                canvas->load_preview(m, is_reload);
+            } else {
+                delete m;
+            }
+        },
+        Qt::QueuedConnection);
+    connect(loader, &Loader::finished, this, [=] {
+        // Each job renders into its own file (or FIFO), which is no
+        // longer needed
+        remove_scratch(fileName);
+        if (loader_job == job) {
+            canvas->clear_preview();
+            finish_job();
+        }
+    });
+    connect(
+        loader, &Loader::got_stats, this,
+        [=](const LoadStats &stats) {
+            canvas->set_load_stats(stats);
+            log(tr("Loaded %1 triangles (%2 MB peak vertex storage, "
+                   "%3 reallocations).")
+                    .arg(stats.triangles)
+                    .arg(stats.peak_bytes / 1e6, 0, 'f', 1)
+                    .arg(stats.reallocations));
+        },
+        Qt::QueuedConnection);
 //
 //    QMessageBox::critical(this, "Error",
 
     connect(
         loader, &Loader::error_bad_stl, this, [=] { logError(err_bad_stl); },
         Qt::QueuedConnection);
+    connect(
+        loader, &Loader::error_bad_mesh_file, this,
+        [=] { logError(err_bad_mesh_file); }, Qt::QueuedConnection);
+    connect(
+        loader, &Loader::error_too_large, this,
+        [=] { logError(err_too_large); }, Qt::QueuedConnection);
     connect(
         loader, &Loader::error_empty_mesh, this,
         [=] { logError(err_empty_mesh); }, Qt::QueuedConnection);
     connect(
         loader, &Loader::error_missing_file, this,
         [=] { logError(err_missing_file); }, Qt::QueuedConnection);
+    connect(
+        loader, &Loader::error_export_failed, this,
+        [=] { logError(tr("Could not write %1.").arg(export_path)); },
+        Qt::QueuedConnection);
     connect(
         loader, &Loader::warning_confusing_stl, this,
         [=] { logError(warn_confusing_stl); }, Qt::QueuedConnection);
@@ -280,31 +686,115 @@ bool Tab::open(const QString& fileName) {
 
 
 void Tab::preview(const float res) {
-    if (process.state() == QProcess::ProcessState::Running) {
-        log("Renderer already running.");
+    // This render covers the latest text, so any pending one is moot
+    live_pending = false;
+    refining = false;
+
+    if (res > 0) {
+        start_preview(res);
         return;
     }
 
-    if (!stl.isOpen()) {
-        // this actually creates the temporary filename
-        stl.open();
+    // Otherwise, start with a coarse pass and refine towards the target.
+    // If the target is already cached, there's nothing to refine.
+    QSettings settings("ImplicitCAD", "ExplicitCAD");
+    const float target =
+        settings.value("render/preview_resolution", 0.0).toFloat();
+    const float coarse =
+        settings.value("render/coarse_resolution", 4.0).toFloat();
+    if (settings.value("render/progressive", true).toBool() &&
+        (target == 0 || coarse > target) &&
+        !MeshCache::instance().contains(MeshCache::key(code->text(), target))) {
+        refining = true;
+        target_res = target;
+        start_preview(coarse);
+    } else {
+        start_preview(target);
     }
+}
 
-    const QString tempfilename = QDir::tempPath() + "/explicitcadtemp.escad";
+void Tab::start_preview(const float res)
+{
+    abort_job(tr("Superseded the previous render"));
+    pass_res = res;
+    pass_loaded = false;
+
+    // Skip extopenscad and parsing if this exact script has been rendered
+    // before.  The entry is still read on a loader, which also rebuilds
+    // what the cache doesn't store (levels of detail and the picking
+    // hierarchy) away from the GUI thread.
+    auto &cache = MeshCache::instance();
+    cache_key = cache.enabled() ? MeshCache::key(code->text(), res)
+                                : QByteArray();
+    if (!cache_key.isEmpty() && cache.contains(cache_key)) {
+        start_job();
+        export_path.clear();
+        final_job = false;
+        streaming_job = false;
+        load_stl(QString(), reload, cache_key);
+        reload = true;
+        return;
+    }
+    render_preview(res);
+}
+
+void Tab::render_preview(const float res)
+{
+    if (!scratch.isValid()) {
+        logError(tr("Could not create a temporary directory: %1")
+                     .arg(scratch.errorString()));
+        return;
+    }
+
+    const QString tempfilename = scratch.filePath("preview.escad");
     const auto ret = writeFile(tempfilename);
     if (!ret.first) {
         // TODO: Display user massage failure
         return;
     }
 
-    canvas->set_status("Rendering preview …");
-    call_implicitcad(tempfilename, stl.fileName());
+    export_path.clear();
+    final_job = false;
+    canvas->set_status(refining ? tr("Rendering preview at resolution %1 …")
+                                      .arg(res)
+                                : tr("Rendering preview …"));
+
+    // Where possible, have extopenscad write into a FIFO that the loader
+    // parses while the render is still running, instead of a temp file
+    QSettings settings("ImplicitCAD", "ExplicitCAD");
+    const QString fifo = scratch_file("fifo");
+    streaming_job = settings.value("render/stream", true).toBool() &&
+                    open_fifo(fifo);
+    if (streaming_job) {
+        call_implicitcad(tempfilename, fifo, res);
+        load_stl(fifo, reload, cache_key, export_path);
+    } else {
+        call_implicitcad(tempfilename, scratch_file("stl"), res);
+    }
 }
 
 void Tab::render(const QString &fileName, const float res)
 {
     // TODO save if 'curFile' has been modified or is empty …
-    call_implicitcad(curFile, fileName, res);
+
+    // The cache only holds previews of the editor contents
+    cache_key.clear();
+    streaming_job = false;
+    final_job = true;
+
+    // Nor should a pending or refining preview replace the exported mesh
+    live_pending = false;
+    refining = false;
+
+    // extopenscad can't write our mesh format, so render an STL and have
+    // the loader convert it once it has been deduplicated
+    if (QFileInfo(fileName).suffix() == MeshFile::extension) {
+        export_path = fileName;
+        call_implicitcad(curFile, scratch_file("stl"), res);
+    } else {
+        export_path.clear();
+        call_implicitcad(curFile, fileName, res);
+    }
 }
 
 void Tab::cut() { code->cut(); }
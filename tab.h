@@ -1,8 +1,11 @@
 #pragma once
 
+#include <QElapsedTimer>
+#include <QPointer>
 #include <QProcess>
+#include <QTimer>
 #include <QString>
-#include <QTemporaryFile>
+#include <QTemporaryDir>
 #include <QWidget>
 
 #include <Qsci/qsciscintilla.h>
@@ -13,15 +16,19 @@ class ViewWidget;
 class QSplitter;
 class QsciLexer;
 class Canvas;
+class Loader;
+class RenderScheduler;
 
 class Tab : public QWidget
 {
     Q_OBJECT
 
   public:
-    Tab(QWidget *parent = nullptr);
+    Tab(RenderScheduler *scheduler, QWidget *parent = nullptr);
+    ~Tab();
 
   private:
+    RenderScheduler *const scheduler;
     QsciScintilla *code;
     QsciLexer *lexer;
     Canvas *canvas;
@@ -32,9 +39,74 @@ class Tab : public QWidget
 
     QString curFile;
 
-    QProcess process;
-    QTemporaryFile stl;
+    /*  The current job's extopenscad, if it's running */
+    QPointer<QProcess> process;
+    void connect_process(QProcess *p, quint64 render_job,
+                         const QString &output);
+
+    /*  Scratch space for this tab's renders, so that tabs never share
+     *  input or output files.  Every job renders into a new file, so that
+     *  the next job never overwrites one that's still being loaded. */
+    QTemporaryDir scratch;
+    quint64 scratch_files = 0;
+    QString scratch_file(const QString &suffix);
+    /*  Deletes a file if it's in the scratch directory */
+    void remove_scratch(const QString &path);
     bool reload = false;
+    QByteArray cache_key;
+    QString export_path;
+
+    /*  Every render job gets a new number, so that results still in
+     *  flight from a cancelled or superseded job can be told apart and
+     *  dropped.  A job runs from starting extopenscad until its mesh has
+     *  been loaded. */
+    quint64 job = 0;
+    bool job_running = false;
+    QElapsedTimer job_timer;
+    qint64 wasted_ms = 0;
+    qint64 queue_wait_ms = 0;
+    /*  Trace::now() at the start of the job and of extopenscad, since
+     *  neither fits in a scoped span.  Both are recorded as async spans
+     *  keyed by tab and job, as other tabs' jobs overlap them. */
+    qint64 trace_job_start = 0;
+    qint64 trace_render_start = 0;
+    QPointer<Loader> loader;
+
+    void start_job();
+    void finish_job();
+    void abort_job(const QString &reason);
+
+    /*  Lowers the OS priority of a render running for a background tab */
+    void renice(bool background);
+
+    /*  Debounces edits into live previews, see the live settings */
+    QTimer live_timer;
+    bool live_pending = false;
+    /*  From the live/enabled and live/delay_ms settings, so that edits
+     *  don't have to read them on every keystroke */
+    bool live_enabled = false;
+    int live_delay_ms = 750;
+    void live_preview();
+
+    /*  Progressive preview: passes run from render/coarse_resolution
+     *  down towards target_res, each replacing the displayed mesh */
+    bool refining = false;
+    float target_res = 0;
+    float pass_res = 0;
+    bool pass_loaded = false;
+    void start_preview(float res);
+    /*  Starts extopenscad for a preview that isn't in the cache */
+    void render_preview(float res);
+    void refine();
+
+    /*  With render/stream on (Unix only), previews are streamed from
+     *  extopenscad to the loader through a FIFO */
+    int fifo_writer = -1;
+    bool streaming_job = false;
+    /*  Set for final renders, whose meshes are displayed at full precision */
+    bool final_job = false;
+    bool open_fifo(const QString &path);
+    void close_fifo();
     QString stderr_;
     QString stdout_;
 
@@ -44,7 +116,10 @@ class Tab : public QWidget
     void call_implicitcad(const QString &inputFile, const QString outputFile,
                           const float resolution = 0,
                           const QString &format = "stl");
-    void load_stl(const QString &filename, const bool reload = false);
+    /*  Without a filename, the mesh is read from the cache under cache_key */
+    void load_stl(const QString &filename, const bool reload = false,
+                  const QByteArray &cache_key = QByteArray(),
+                  const QString &export_path = QString());
   signals:
     void fileNameChanged(const QString &fileName);
     void copyAvailable(bool) const;
@@ -62,6 +137,14 @@ class Tab : public QWidget
     bool save();
     void preview(float res = 0);
     void render(const QString &fileName, float res = 0.5);
+    void cancel();
+
+    /*  Called when the tab is shown or hidden, to adjust the priority of
+     *  its running render */
+    void set_foreground(bool foreground);
+
+    /*  Picks up the settings this tab keeps a copy of */
+    void read_settings();
     void cut();
     void copy();
     void paste();
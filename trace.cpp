@@ -0,0 +1,140 @@
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QSaveFile>
+#include <QStringList>
+#include <QThread>
+
+#include <chrono>
+#include <utility>
+#include <vector>
+
+#include "trace.h"
+
+std::atomic<bool> Trace::active(false);
+
+namespace
+{
+    struct Event
+    {
+        const char* name;
+        qint64 start;
+        qint64 end;
+        int thread;
+
+        /*  Set for async spans, which are written as begin/end pairs */
+        quintptr scope;
+        quint64 id;
+    };
+
+    const size_t capacity = 1 << 16;
+
+    QMutex mutex;
+    std::vector<Event> events;
+    size_t recorded = 0;
+    QStringList thread_names;
+
+    const auto epoch = std::chrono::steady_clock::now();
+}
+
+void Trace::set_enabled(bool on)
+{
+    active.store(on, std::memory_order_relaxed);
+}
+
+qint64 Trace::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Trace::record(const char* name, qint64 start, qint64 end)
+{
+    record_async(name, start, end, nullptr, 0);
+}
+
+void Trace::record_async(const char* name, qint64 start, qint64 end,
+                         const void* scope, quint64 id)
+{
+    thread_local int thread = -1;
+
+    QMutexLocker lock(&mutex);
+    if (thread < 0)
+    {
+        // Threads are named after their class (e.g. Loader), which is
+        // more use in a trace viewer than an opaque id
+        thread = thread_names.size();
+        QThread* t = QThread::currentThread();
+        thread_names << ((QCoreApplication::instance() &&
+                          t == QCoreApplication::instance()->thread())
+                         ? QString("main")
+                         : QString("%1 %2").arg(t->metaObject()->className())
+                                           .arg(thread));
+    }
+
+    const Event event{name, start, end, thread,
+                      reinterpret_cast<quintptr>(scope), id};
+    if (events.size() < capacity)
+    {
+        events.push_back(event);
+    }
+    else
+    {
+        events[recorded % capacity] = event;
+    }
+    recorded++;
+}
+
+bool Trace::write(const QString& path)
+{
+    QJsonArray out;
+    {
+        QMutexLocker lock(&mutex);
+        for (int i=0; i < thread_names.size(); ++i)
+        {
+            out.append(QJsonObject{
+                {"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", i},
+                {"args", QJsonObject{{"name", thread_names[i]}}}});
+        }
+
+        // Once the buffer has wrapped, the oldest event is the one that
+        // would be overwritten next
+        const size_t first = (recorded > capacity) ? recorded % capacity : 0;
+        for (size_t i=0; i < events.size(); ++i)
+        {
+            const Event& e = events[(first + i) % events.size()];
+            if (!e.scope)
+            {
+                out.append(QJsonObject{
+                    {"name", e.name}, {"ph", "X"}, {"pid", 1},
+                    {"tid", e.thread}, {"ts", e.start / 1000.0},
+                    {"dur", (e.end - e.start) / 1000.0}});
+                continue;
+            }
+
+            // Nestable async events are matched up by category and id,
+            // so overlapping spans from different scopes don't interleave
+            const QString id = QString("%1:%2").arg(e.scope, 0, 16)
+                                               .arg(e.id);
+            for (const auto& p : {std::make_pair("b", e.start),
+                                  std::make_pair("e", e.end)})
+            {
+                out.append(QJsonObject{
+                    {"name", e.name}, {"cat", "async"}, {"ph", p.first},
+                    {"id", id}, {"pid", 1}, {"tid", e.thread},
+                    {"ts", p.second / 1000.0}});
+            }
+        }
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    const QJsonObject doc{{"traceEvents", out}, {"displayTimeUnit", "ms"}};
+    file.write(QJsonDocument(doc).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
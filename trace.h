@@ -0,0 +1,61 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+
+#include <atomic>
+
+/*
+ *  A lightweight tracer for the render pipeline.  Spans from every thread
+ *  go into one fixed-size ring buffer (so a long session keeps only its
+ *  most recent events), and can be written out in Chrome's trace event
+ *  format for loading into Perfetto or chrome://tracing.
+ *
+ *  Tracing is off by default, and while it's off a span costs a single
+ *  relaxed atomic load.
+ */
+namespace Trace
+{
+    extern std::atomic<bool> active;
+
+    inline bool enabled() { return active.load(std::memory_order_relaxed); }
+    void set_enabled(bool on);
+
+    /*  Returns nanoseconds since the program started */
+    qint64 now();
+
+    /*  Records a span that has already finished.  The name isn't copied,
+     *  so it should be a string literal. */
+    void record(const char* name, qint64 start, qint64 end);
+
+    /*  Records a span that belongs to some piece of work rather than to
+     *  the thread it was recorded on (such as one tab's render job, which
+     *  may overlap with other tabs' jobs on the main thread).  Spans with
+     *  the same scope and id share a track of their own in the viewer. */
+    void record_async(const char* name, qint64 start, qint64 end,
+                      const void* scope, quint64 id);
+
+    /*  Writes every recorded span to the given file as trace event JSON */
+    bool write(const QString& path);
+
+    /*  Records a span from its construction until it goes out of scope */
+    class Span
+    {
+    public:
+        explicit Span(const char* name)
+            : name(name), start(enabled() ? now() : -1) {}
+        ~Span()
+        {
+            if (start >= 0)
+            {
+                record(name, start, now());
+            }
+        }
+
+    private:
+        const char* const name;
+        const qint64 start;
+    };
+}
+
+#endif // TRACE_H